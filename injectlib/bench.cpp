@@ -0,0 +1,288 @@
+// Standalone microbenchmarks for the per-frame strafing code.  The movement
+// and strafemath translation units are compiled straight into this file so
+// that their static functions can be timed, and the engine is replaced by the
+// stubs below: an endless floor at z = 0 for traces, and zeroed memory for
+// the engine structures with just the fields read by movement.cpp filled in.
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <x86intrin.h>
+
+#include "strafemath.cpp"
+#include "movement.cpp"
+
+Cvar_SetValue_func_t orig_Cvar_SetValue = nullptr;
+Cvar_RegisterVariable_func_t orig_Cvar_RegisterVariable = nullptr;
+Con_Printf_func_t orig_Con_Printf = nullptr;
+double *p_host_frametime = nullptr;
+uintptr_t *pp_sv_player = nullptr;
+const char *gamedir = "";
+unsigned int *p_g_ulFrameCount = nullptr;
+uintptr_t *pp_gpGlobals = nullptr;
+cvar_t sv_taslog = {"sv_taslog", "0", 0, 0, nullptr};
+cvar_t sv_taslog_channels = {"sv_taslog_channels", "2047", 0, 2047, nullptr};
+bool mvmt_clipped = false;
+
+void abort_with_err(const char *errstr, ...)
+{
+    va_list args;
+    va_start(args, errstr);
+    std::vfprintf(stderr, errstr, args);
+    va_end(args);
+    std::fputc('\n', stderr);
+    std::abort();
+}
+
+void taslog_write(const void *, size_t)
+{
+}
+
+static const int NUM_SAMPLES = 1 << 16;
+static const int NUM_ITERS = 32;
+
+static double stub_frametime = 0.01;
+static uintptr_t stub_sv_player;
+static uintptr_t stub_pmove;
+static char edict_mem[0x400] __attribute__((aligned(16)));
+static char pmove_mem[0x50000] __attribute__((aligned(16)));
+static float movevars_mem[16];
+static float stub_viewangles[3];
+static kbutton_t stub_buttons[8];
+static cvar_t stub_cvars[8];
+static cvar_t *stub_cvar_ptrs[4];
+static volatile double sink;
+
+static pmtrace_t stub_PM_PlayerTrace(float *start, float *end, int, int)
+{
+    int usehull = *(int *)(*pp_hwpmove + 0xbc);
+    float (*player_mins)[3] = (float (*)[3])(*pp_hwpmove + 0x4f4f4);
+    float t1 = start[2] + player_mins[usehull][2];
+    float t2 = end[2] + player_mins[usehull][2];
+
+    pmtrace_t tr = pmtrace_t();
+    tr.fraction = 1;
+    tr.ent = -1;
+    for (int i = 0; i < 3; i++)
+        tr.endpos[i] = end[i];
+    if (t1 < 0) {
+        tr.startsolid = tr.allsolid = t2 < 0;
+    } else if (t2 < 0) {
+        tr.fraction = std::max(0.0f, (t1 - 0.03125f) / (t1 - t2));
+        for (int i = 0; i < 3; i++)
+            tr.endpos[i] = start[i] + tr.fraction * (end[i] - start[i]);
+        tr.plane.normal[2] = 1;
+        tr.ent = 0;
+    }
+    return tr;
+}
+
+static void stub_GetViewAngles(float *va)
+{
+    for (int i = 0; i < 3; i++)
+        va[i] = stub_viewangles[i];
+}
+
+static void stub_SetViewAngles(float *va)
+{
+    for (int i = 0; i < 3; i++)
+        stub_viewangles[i] = va[i];
+}
+
+static void stub_keyin()
+{
+}
+
+static void stub_Cbuf_InsertTextLines(const char *)
+{
+}
+
+static void setup_engine_stubs()
+{
+    p_host_frametime = &stub_frametime;
+    stub_sv_player = (uintptr_t)edict_mem;
+    pp_sv_player = &stub_sv_player;
+    stub_pmove = (uintptr_t)pmove_mem;
+    pp_hwpmove = &stub_pmove;
+    p_movevars = (uintptr_t)movevars_mem;
+
+    movevars_mem[0] = 800;      // gravity
+    movevars_mem[1] = 100;      // stopspeed
+    movevars_mem[2] = 320;      // maxspeed
+    movevars_mem[4] = 10;       // accelerate
+    movevars_mem[5] = 10;       // airaccelerate
+    movevars_mem[7] = 4;        // friction
+    movevars_mem[8] = 2;        // edgefriction
+    *(float *)(edict_mem + 0x80 + 0x11c) = 1;       // gravity
+    *(float *)(edict_mem + 0x80 + 0x120) = 1;       // friction
+
+    float player_mins[4][3] = {
+        {-16, -16, -36}, {-16, -16, -18}, {0, 0, 0}, {-32, -32, -32}
+    };
+    std::memcpy(pmove_mem + 0x4f4f4, player_mins, sizeof(player_mins));
+
+    orig_PM_PlayerTrace = stub_PM_PlayerTrace;
+    orig_GetViewAngles = stub_GetViewAngles;
+    orig_SetViewAngles = stub_SetViewAngles;
+    orig_Cbuf_InsertTextLines = stub_Cbuf_InsertTextLines;
+    orig_IN_BackDown = orig_IN_BackUp = stub_keyin;
+    orig_IN_MoveleftDown = orig_IN_MoveleftUp = stub_keyin;
+    orig_IN_MoverightDown = orig_IN_MoverightUp = stub_keyin;
+    orig_IN_DuckDown = orig_IN_DuckUp = stub_keyin;
+    orig_IN_JumpDown = orig_IN_JumpUp = stub_keyin;
+
+    p_in_duck = &stub_buttons[0];
+    p_in_jump = &stub_buttons[1];
+    p_in_forward = &stub_buttons[2];
+    p_in_back = &stub_buttons[3];
+    p_in_moveright = &stub_buttons[4];
+    p_in_moveleft = &stub_buttons[5];
+    p_in_up = &stub_buttons[6];
+    p_in_down = &stub_buttons[7];
+
+    for (int i = 0; i < 4; i++) {
+        stub_cvars[i].value = TAS_FSU_MAG;
+        stub_cvar_ptrs[i] = &stub_cvars[i];
+    }
+    pp_cl_forwardspeed = &stub_cvar_ptrs[0];
+    pp_cl_backspeed = &stub_cvar_ptrs[1];
+    pp_cl_sidespeed = &stub_cvar_ptrs[2];
+    pp_cl_upspeed = &stub_cvar_ptrs[3];
+    cl_db4c_ceil = &stub_cvars[4];
+    cl_lgagst_origM = &stub_cvars[5];
+    cl_mtype = &stub_cvars[6];
+    cl_mtype->value = 1;
+    cl_tas_lookahead = &stub_cvars[7];
+    cl_tas_lookahead->value = 1;
+}
+
+// A player state as found in the game, with speeds spread logarithmically
+// between walking and bunnyhopping speeds and a uniform direction.
+struct sample_t
+{
+    double vel[3];
+    double pos[3];
+    double yaw;
+    double nofricspd;
+};
+
+static std::vector<sample_t> make_samples(bool onground)
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<double> logspd(std::log(10.0),
+                                                  std::log(2000.0));
+    std::uniform_real_distribution<double> ang(-M_PI, M_PI);
+    std::uniform_real_distribution<double> vspd(-400, 400);
+    std::uniform_real_distribution<double> height(40, 200);
+
+    std::vector<sample_t> samples(NUM_SAMPLES);
+    for (sample_t &s : samples) {
+        double spd = std::exp(logspd(rng));
+        double dir = ang(rng);
+        s.vel[0] = spd * std::cos(dir);
+        s.vel[1] = spd * std::sin(dir);
+        s.vel[2] = onground ? 0 : vspd(rng);
+        s.pos[0] = ang(rng) * 1000;
+        s.pos[1] = ang(rng) * 1000;
+        s.pos[2] = onground ? 36 : height(rng);
+        s.yaw = ang(rng);
+        s.nofricspd = spd * 1.01;
+    }
+    return samples;
+}
+
+// Time body over every sample several times, and report the per call cost
+// as wall time and TSC cycles along with the throughput.
+template<typename F>
+static void run_bench(const char *name, const std::vector<sample_t> &samples,
+                      F body)
+{
+    for (const sample_t &s : samples)
+        body(s);
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t tsc_start = __rdtsc();
+    for (int iter = 0; iter < NUM_ITERS; iter++)
+        for (const sample_t &s : samples)
+            body(s);
+    uint64_t tsc_end = __rdtsc();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    double calls = (double)NUM_ITERS * samples.size();
+    std::printf("%-24s %9.2f ns/call %9.1f cycles/call %12.0f calls/s\n",
+                name, elapsed.count() / calls * 1e9,
+                (tsc_end - tsc_start) / calls, calls / elapsed.count());
+}
+
+static void load_sample(const sample_t &s)
+{
+    float *pos = (float *)(edict_mem + 0x80 + 0x8);
+    float *vel = (float *)(edict_mem + 0x80 + 0x20);
+    for (int i = 0; i < 3; i++) {
+        pos[i] = s.pos[i];
+        vel[i] = s.vel[i];
+    }
+    stub_viewangles[1] = s.yaw * 180 / M_PI;
+}
+
+int main()
+{
+    setup_engine_stubs();
+    std::vector<sample_t> air = make_samples(false);
+    std::vector<sample_t> ground = make_samples(true);
+    const double L = 30, tau = 0.01, M = 320, A = 10;
+    const double tauMA = tau * M * A;
+
+    run_bench("anglemod_rad", air, [](const sample_t &s) {
+        sink = anglemod_rad(s.yaw + M_PI);
+    });
+    run_bench("strafe_theta_const", air, [&](const sample_t &s) {
+        sink = strafe_theta_const(std::hypot(s.vel[0], s.vel[1]),
+                                  s.nofricspd, L, tauMA);
+    });
+    run_bench("strafe_side", air, [&](const sample_t &s) {
+        double vel[2] = {s.vel[0], s.vel[1]};
+        double yaw = s.yaw;
+        int Sdir, Fdir;
+        double theta = strafe_theta_opt(std::hypot(vel[0], vel[1]), L, tauMA);
+        strafe_side(yaw, Sdir, Fdir, vel, theta, L, tauMA, 1);
+        sink = yaw + vel[0];
+    });
+    run_bench("strafe_line_opt", air, [&](const sample_t &s) {
+        static const double origin[2] = {0, 0};
+        static const double dir[2] = {1, 0};
+        double vel[2] = {s.vel[0], s.vel[1]};
+        double yaw = s.yaw;
+        int Sdir, Fdir;
+        strafe_line_opt(yaw, Sdir, Fdir, vel, s.pos, L, tau, M * A,
+                        origin, dir);
+        sink = yaw + vel[0];
+    });
+
+    // The whole decision path of one CL_CreateMove, minus the engine.
+    auto tas_frame = [](const sample_t &s) {
+        load_sample(s);
+        do_tas_actions();
+        g_old_moveaction = g_moveaction;
+        jump_action = duck_action = 0;
+        sink = stub_viewangles[1];
+    };
+    g_moveaction = StrafeRight;
+    run_bench("do_tas_actions air", air, tas_frame);
+    g_moveaction = StrafeLine;
+    run_bench("do_tas_actions line", air, tas_frame);
+    g_moveaction = StrafeRight;
+    tas_cjmp = tas_lgagst = -1;
+    run_bench("do_tas_actions ground", ground, tas_frame);
+    tas_cjmp = tas_lgagst = 0;
+    tas_db4c = tas_db4l = tas_jb = -1;
+    run_bench("do_tas_actions autoact", air, tas_frame);
+    cl_tas_lookahead->value = 8;
+    run_bench("do_tas_actions autoact 8", air, tas_frame);
+    return 0;
+}
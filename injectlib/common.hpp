@@ -27,12 +27,21 @@ extern Con_Printf_func_t orig_Con_Printf;
 
 extern double *p_host_frametime;
 extern uintptr_t *pp_sv_player;
-extern const char *game_dir;
+extern const char *gamedir;
 extern unsigned int *p_g_ulFrameCount;
 extern uintptr_t *pp_gpGlobals;
 extern cvar_t sv_taslog;
+extern cvar_t sv_taslog_channels;
+extern cvar_t sv_tas_turbo;
 extern bool mvmt_clipped;
+extern unsigned int server_gen;
 
 void abort_with_err(const char *errstr, ...);
 
+// The sv_taslog_channels bits to log, or 0 when sv_taslog is off.
+inline unsigned int taslog_channels()
+{
+    return sv_taslog.value ? (unsigned int)sv_taslog_channels.value : 0;
+}
+
 #endif
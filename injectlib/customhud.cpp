@@ -2,6 +2,7 @@
 #include <cmath>
 #include "customhud.hpp"
 #include "common.hpp"
+#include "tasperf.hpp"
 
 #define ScreenWidth (*(int *)(p_gHUD + 0x1f98 + 0x4))
 #define ScreenHeight (*(int *)(p_gHUD + 0x1f98 + 0x8))
@@ -67,21 +68,75 @@ static DrawConsoleString_func_t orig_DrawConsoleString = nullptr;
 static DrawSetTextColor_func_t orig_DrawSetTextColor = nullptr;
 static Draw_FillRGBA_func_t orig_Draw_FillRGBA = nullptr;
 
+// A line of the HUD, formatted again only when its value changes.
+struct hudfield_t
+{
+    const char *format;
+    double value;
+    bool valid;
+    char str[30];
+};
+
+static hudfield_t hud_fields[] = {
+    {"H: %.8g\n", 0, false, ""},
+    {"V: %.8g\n", 0, false, ""},
+    {"AH: %.8g\n", 0, false, ""},
+    {"AV: %.8g\n", 0, false, ""},
+    {"Y: %.8g\n", 0, false, ""},
+    {"P: %.8g\n", 0, false, ""},
+    {"HP: %.8g\n", 0, false, ""},
+    {"EHP: %.8g\n", 0, false, ""},
+};
+
+// The view the entity under the crosshair was last traced from, and the
+// server and serial number of that entity to tell if it is still the same.
+static float crosshair_start[3];
+static float crosshair_angles[3];
+static uintptr_t crosshair_ent = 0;
+static unsigned int crosshair_gen = 0;
+static int crosshair_serial = 0;
+
+static void draw_field(int index, double value)
+{
+    hudfield_t &field = hud_fields[index];
+    if (!field.valid || std::memcmp(&value, &field.value, sizeof(value))) {
+        snprintf(field.str, sizeof(field.str), field.format, value);
+        field.value = value;
+        field.valid = true;
+    }
+    orig_DrawConsoleString(10, 20 + 10 * index, field.str);
+}
+
 static float get_entity_health()
 {
     float *plrorigin = (float *)(*pp_sv_player + 0x80 + 0x8);
     float *viewofs = (float *)(*pp_sv_player + 0x80 + 0x174);
+    float *angles = (float *)(*pp_sv_player + 0x80 + 0x74);
     float start[3] = {plrorigin[0] + viewofs[0], plrorigin[1] + viewofs[1],
                       plrorigin[2] + viewofs[2]};
-    orig_PF_makevectors_I((float *)(*pp_sv_player + 0x80 + 0x74));
-    float *g_forward = (float *)(*pp_gpGlobals + 0x28);
-    float end[3];
-    for (int i = 0; i < 3; i++)
-        end[i] = plrorigin[i] + 8192 * g_forward[i];
-
-    TraceResult trace;
-    orig_PF_traceline_DLL(start, end, 0, *pp_sv_player, &trace);
-    return *(float *)(trace.pHit + 0x80 + 0x160);
+
+    // Only trace again when the view has moved, or when the entity has gone
+    // with a new server or been freed.  The health is still read every time,
+    // as it may change while the view stays put.
+    if (!crosshair_ent || crosshair_gen != server_gen ||
+        *(int *)(crosshair_ent + 0x4) != crosshair_serial ||
+        std::memcmp(start, crosshair_start, sizeof(start)) ||
+        std::memcmp(angles, crosshair_angles, sizeof(crosshair_angles))) {
+        orig_PF_makevectors_I(angles);
+        float *g_forward = (float *)(*pp_gpGlobals + 0x28);
+        float end[3];
+        for (int i = 0; i < 3; i++)
+            end[i] = plrorigin[i] + 8192 * g_forward[i];
+
+        TraceResult trace;
+        orig_PF_traceline_DLL(start, end, 0, *pp_sv_player, &trace);
+        crosshair_ent = trace.pHit;
+        crosshair_gen = server_gen;
+        crosshair_serial = *(int *)(crosshair_ent + 0x4);
+        std::memcpy(crosshair_start, start, sizeof(start));
+        std::memcpy(crosshair_angles, angles, sizeof(crosshair_angles));
+    }
+    return *(float *)(crosshair_ent + 0x80 + 0x160);
 }
 
 static void draw_blocked(float flTime)
@@ -112,17 +167,15 @@ int CHudPlrInfo::Init()
 
 int CHudPlrInfo::Draw(float flTime)
 {
+    perf_scope_t perf(PerfHudDraw);
+    if (sv_tas_turbo.value)
+        return 0;
     orig_DrawSetTextColor(default_color[0], default_color[1],
                           default_color[2]);
 
-    char dispstr[30];
-
     float *vel = (float *)(*pp_sv_player + 0x80 + 0x20);
-    snprintf(dispstr, sizeof(dispstr), "H: %.8g\n",
-             std::hypot(vel[0], vel[1]));
-    orig_DrawConsoleString(10, 20, dispstr);
-    snprintf(dispstr, sizeof(dispstr), "V: %.8g\n", vel[2]);
-    orig_DrawConsoleString(10, 30, dispstr);
+    draw_field(0, std::hypot(vel[0], vel[1]));
+    draw_field(1, vel[2]);
 
     static float prev_origin[3] = {0, 0, 0};
     float *origin = (float *)(*pp_sv_player + 0x80 + 0x8);
@@ -131,26 +184,16 @@ int CHudPlrInfo::Draw(float flTime)
         dvel[i] = (origin[i] - prev_origin[i]) / *p_host_frametime;
         prev_origin[i] = origin[i];
     }
-    snprintf(dispstr, sizeof(dispstr), "AH: %.8g\n",
-             std::hypot(dvel[0], dvel[1]));
-    orig_DrawConsoleString(10, 40, dispstr);
-    snprintf(dispstr, sizeof(dispstr), "AV: %.8g\n", dvel[2]);
-    orig_DrawConsoleString(10, 50, dispstr);
+    draw_field(2, std::hypot(dvel[0], dvel[1]));
+    draw_field(3, dvel[2]);
 
     float viewangles[3];
     orig_GetViewAngles(viewangles);
-    snprintf(dispstr, sizeof(dispstr), "Y: %.8g\n", viewangles[1]);
-    orig_DrawConsoleString(10, 60, dispstr);
-    snprintf(dispstr, sizeof(dispstr), "P: %.8g\n", viewangles[0]);
-    orig_DrawConsoleString(10, 70, dispstr);
-
-    float health = *(float *)(*pp_sv_player + 0x80 + 0x160);
-    snprintf(dispstr, sizeof(dispstr), "HP: %.8g\n", health);
-    orig_DrawConsoleString(10, 80, dispstr);
+    draw_field(4, viewangles[1]);
+    draw_field(5, viewangles[0]);
 
-    float ent_hp = get_entity_health();
-    snprintf(dispstr, sizeof(dispstr), "EHP: %.8g\n", ent_hp);
-    orig_DrawConsoleString(10, 90, dispstr);
+    draw_field(6, *(float *)(*pp_sv_player + 0x80 + 0x160));
+    draw_field(7, get_entity_health());
 
     int ducked = *(int *)(*pp_sv_player + 0x80 + 0x1a4) & FL_DUCKING;
     if (ducked)
@@ -168,12 +211,22 @@ int CHudPlrInfo::Draw(float flTime)
 void initialize_customhud(uintptr_t clso_addr, const symtbl_t &clso_st,
                           uintptr_t hwso_addr, const symtbl_t &hwso_st)
 {
-    orig_PF_makevectors_I = (PF_makevectors_I_func_t)(hwso_addr + hwso_st.at("PF_makevectors_I"));
-    orig_PF_traceline_DLL = (PF_traceline_DLL_func_t)(hwso_addr + hwso_st.at("PF_traceline_DLL"));
-    orig_Draw_FillRGBA = (Draw_FillRGBA_func_t)(hwso_addr + hwso_st.at("Draw_FillRGBA"));
-    p_gHUD = (uintptr_t)(clso_addr + clso_st.at("gHUD"));
-    p_gEngfuncs = (uintptr_t)(clso_addr + clso_st.at("gEngfuncs"));
-    orig_AddHudElem = (AddHudElem_func_t)(clso_addr + clso_st.at("_ZN4CHud10AddHudElemEP8CHudBase"));
+    static const symreq_t clso_syms[] = {
+        {"gHUD", &p_gHUD, true},
+        {"gEngfuncs", &p_gEngfuncs, true},
+        {"_ZN4CHud10AddHudElemEP8CHudBase", &orig_AddHudElem, true},
+    };
+    static const symreq_t hwso_syms[] = {
+        {"PF_makevectors_I", &orig_PF_makevectors_I, true},
+        {"PF_traceline_DLL", &orig_PF_traceline_DLL, true},
+        {"Draw_FillRGBA", &orig_Draw_FillRGBA, true},
+    };
+
+    if (!resolve_symbols("client.so", clso_addr, clso_st, clso_syms))
+        abort_with_err("Failed to resolve the symbols needed from client.so.");
+    if (!resolve_symbols("hw.so", hwso_addr, hwso_st, hwso_syms))
+        abort_with_err("Failed to resolve the symbols needed from hw.so.");
+
     orig_DrawConsoleString = *(DrawConsoleString_func_t *)(p_gEngfuncs + 0x6c);
     orig_DrawSetTextColor = *(DrawSetTextColor_func_t *)(p_gEngfuncs + 0x70);
     hudPlrInfo.Init();
@@ -0,0 +1,61 @@
+#ifndef FRAMETIME_H
+#define FRAMETIME_H
+
+#include <cmath>
+
+// The engine does not move the player by host_frametime.  CL_Move sends the
+// frame time to the server as usercmd_t::msec, truncated to a whole number of
+// milliseconds, and carries the truncated part over to the next frame.  The
+// player is then moved by msec / 1000, which only averages out to
+// host_frametime.  This repeats that quantization so that predictions move the
+// player by the same amount as PM_PlayerMove does.  The remainder is summed in
+// a long double, so that it does not drift from the engine's over a long run
+// at frame times such as 1/750 which have no exact binary form.
+class frametime_acc_t
+{
+public:
+    frametime_acc_t() : remainder(0), last_msec(-1) {}
+
+    void reset()
+    {
+        remainder = 0;
+        last_msec = -1;
+    }
+
+    // The msec the engine will send for a frame of frametime seconds.
+    int next(double frametime)
+    {
+        long double total = (long double)frametime * 1000 + remainder;
+        int msec = (int)std::floor(total);
+        remainder = total - msec;
+        // usercmd_t::msec is a byte.
+        if (msec > 255)
+            msec = 255;
+        else if (msec < 0)
+            msec = 0;
+        last_msec = msec;
+        return msec;
+    }
+
+    // Realign with the msec the engine actually sent for the frame last given
+    // to next.  A different msec means our remainder is off by about the
+    // difference, so shift it by that and clamp it to what the engine could
+    // have been holding.
+    void sync(int msec)
+    {
+        if (last_msec < 0 || msec == last_msec)
+            return;
+        remainder += last_msec - msec;
+        if (remainder < 0)
+            remainder = 0;
+        else if (remainder >= 1)
+            remainder = 1 - 1e-9L;
+        last_msec = msec;
+    }
+
+private:
+    long double remainder;
+    int last_msec;
+};
+
+#endif
@@ -1,8 +1,11 @@
+#include <chrono>
 #include <cmath>
 #include <cstdio>
 #include <cstring>
 #include <unistd.h>
 #include <cstdarg>
+#include <string>
+#include <vector>
 #ifdef OPPOSINGFORCE
 #include <dlfcn.h>
 #endif
@@ -10,6 +13,9 @@
 #include "common.hpp"
 #include "movement.hpp"
 #include "customhud.hpp"
+#include "taslog.hpp"
+#include "tasperf.hpp"
+#include "tasbranch.hpp"
 
 #ifdef OPPOSINGFORCE
 #define HLSO_NAME "opfor.so"
@@ -56,9 +62,12 @@ typedef void (*InitInput_func_t)();
 typedef void (*SV_SendClientMessages_func_t)();
 typedef uintptr_t (*SZ_GetSpace_func_t)(uintptr_t, int);
 typedef void (*PlayerPreThink_func_t)(edict_s *);
+typedef void (*ServerActivate_func_t)(edict_s *, int, int);
 typedef void (*CWorld_KeyValue_func_t)(CWorld *, KeyValueData_s *);
 typedef int (*CBasePlayer_TakeDamage_func_t)(CBasePlayer *, entvars_s *, entvars_s *, float, int);
 typedef void (*Cmd_AddGameCommand_func_t)(const char *, void (*)());
+typedef int (*Cmd_Argc_func_t)();
+typedef void (*Cbuf_AddText_func_t)(const char *);
 typedef void (*CGauss_StartFire_func_t)(CGauss *);
 typedef void (*CGauss_PrimaryAttack_func_t)(CGauss *);
 typedef int (*CBasePlayerWeapon_DefaultDeploy_func_t)(CBasePlayerWeapon *, char *, char *, int, char *, int, int);
@@ -74,13 +83,20 @@ static cvar_t sv_show_triggers;
 static cvar_t sv_sim_qg;
 static cvar_t sv_sim_qws;
 static cvar_t sv_sim_grf;
+static cvar_t sv_taslog_dropped;
+static cvar_t sv_tas_turbo_fps;
 static int in_walkmove = 0;
 static int flymove_numtouches[2];
 static float flymove_vel1[3];
 static float flymove_pos1[3];
 
 bool mvmt_clipped = false;
+// Bumped whenever the server is started, by a new map or a saved game, so
+// that pointers to edicts of an earlier server can be told apart.
+unsigned int server_gen = 0;
 cvar_t sv_taslog;
+cvar_t sv_taslog_channels;
+cvar_t sv_tas_turbo;
 bool tas_hook_initialized = false;
 
 Cvar_RegisterVariable_func_t orig_Cvar_RegisterVariable = nullptr;
@@ -109,6 +125,7 @@ static PM_WalkMove_func_t orig_cl_PM_WalkMove = nullptr;
 static SV_SendClientMessages_func_t orig_SV_SendClientMessages = nullptr;
 static SZ_GetSpace_func_t orig_SZ_GetSpace = nullptr;
 static PlayerPreThink_func_t orig_PlayerPreThink = nullptr;
+static ServerActivate_func_t orig_ServerActivate = nullptr;
 static CWorld_KeyValue_func_t orig_CWorld_KeyValue = nullptr;
 static CBasePlayer_TakeDamage_func_t orig_CBasePlayer_TakeDamage = nullptr;
 static CGauss_StartFire_func_t orig_hl_CGauss_StartFire = nullptr;
@@ -117,14 +134,51 @@ static CGauss_PrimaryAttack_func_t orig_hl_CGauss_PrimaryAttack = nullptr;
 static CGauss_PrimaryAttack_func_t orig_cl_CGauss_PrimaryAttack = nullptr;
 static Cmd_AddGameCommand_func_t orig_Cmd_AddGameCommand = nullptr;
 static Cmd_Argv_func_t orig_Cmd_Argv = nullptr;
+static Cmd_Argc_func_t orig_Cmd_Argc = nullptr;
+static Cbuf_AddText_func_t orig_Cbuf_AddText = nullptr;
 static CBasePlayerWeapon_DefaultDeploy_func_t orig_hl_CBasePlayerWeapon_DefaultDeploy = nullptr;
 static CBasePlayerWeapon_DefaultDeploy_func_t orig_cl_CBasePlayerWeapon_DefaultDeploy = nullptr;
 
 static cvar_t *p_r_norefresh = nullptr;
+static uintptr_t p_cmd_text = 0;
 static uintptr_t p_pmove = 0;
 static int *p_g_onladder = nullptr;
 static uintptr_t p_g_Gauss = 0;
 
+// What AddToFullPack needs to know about the class of an entity, worked out
+// the first time the entity is seen.  An entry is stale if it was filled for
+// an earlier map, or for an entity which used the edict before, which is
+// told by the serial number the engine bumps whenever an edict is freed.
+struct edictclass_t
+{
+    unsigned int gen;
+    int serialnumber;
+    unsigned int classname;
+    bool is_trigger;
+    int amt;
+    char colors[3];
+};
+
+static const int MAX_EDICTS = 2048;
+static edictclass_t edict_classes[MAX_EDICTS];
+static unsigned int edict_classes_gen = 1;
+
+// Message buffers found to be filling up in turbo mode, which nothing drains
+// while SV_SendClientMessages is skipped.  Writes to them go to turbo_scratch
+// instead.
+static const int MAX_TURBO_SINKS = 16;
+static uintptr_t turbo_sinks[MAX_TURBO_SINKS];
+static int num_turbo_sinks = 0;
+static char turbo_scratch[1 << 16];
+
+// Host frames run since turbo mode was turned on and since sv_tas_turbo_fps
+// was last updated.
+static bool turbo_on = false;
+static unsigned long turbo_frames = 0;
+static unsigned long turbo_window_frames = 0;
+static std::chrono::steady_clock::time_point turbo_start;
+static std::chrono::steady_clock::time_point turbo_window_start;
+
 static const int EF_NODRAW = 128;
 static const int kRenderNormal = 0;
 static const int kRenderTransColor = 1;
@@ -147,68 +201,87 @@ static inline const char *hlname_to_string(unsigned int name)
 
 static void load_cl_symbols()
 {
+    static const symreq_t syms[] = {
+        {"PM_Move", &orig_cl_PM_Move, true},
+        {"PM_FlyMove", &orig_cl_PM_FlyMove, true},
+        {"PM_WalkMove", &orig_cl_PM_WalkMove, true},
+        {"_Z9InitInputv", &orig_InitInput, true},
+        {"_ZN6CGauss9StartFireEv", &orig_cl_CGauss_StartFire, true},
+        {"_ZN6CGauss13PrimaryAttackEv", &orig_cl_CGauss_PrimaryAttack, true},
+        {"_ZN17CBasePlayerWeapon13DefaultDeployEPcS0_iS0_ii",
+         &orig_cl_CBasePlayerWeapon_DefaultDeploy, true},
+        {"g_Gauss", &p_g_Gauss, true},
+    };
+
     std::string clso_fullpath;
     get_loaded_lib_info("client.so", clso_addr, clso_fullpath);
     if (!clso_addr)
         abort_with_err("Failed to get the base address of client.so.");
     clso_st = get_symbols(clso_fullpath.c_str());
-
-    orig_cl_PM_Move = (PM_Move_func_t)(clso_addr + clso_st["PM_Move"]);
-    orig_cl_PM_FlyMove = (PM_FlyMove_func_t)(clso_addr + clso_st["PM_FlyMove"]);
-    orig_cl_PM_WalkMove = (PM_WalkMove_func_t)(clso_addr + clso_st["PM_WalkMove"]);
-    orig_InitInput = (InitInput_func_t)(clso_addr + clso_st["_Z9InitInputv"]);
-    orig_cl_CGauss_StartFire = (CGauss_StartFire_func_t)(clso_addr + clso_st["_ZN6CGauss9StartFireEv"]);
-    orig_cl_CGauss_PrimaryAttack = (CGauss_PrimaryAttack_func_t)(clso_addr + clso_st["_ZN6CGauss13PrimaryAttackEv"]);
-    orig_cl_CBasePlayerWeapon_DefaultDeploy = (CBasePlayerWeapon_DefaultDeploy_func_t)(clso_addr + clso_st["_ZN17CBasePlayerWeapon13DefaultDeployEPcS0_iS0_ii"]);
-    p_g_Gauss = clso_addr + clso_st["g_Gauss"];
+    if (!resolve_symbols("client.so", clso_addr, clso_st, syms))
+        abort_with_err("Failed to resolve the symbols needed from client.so.");
 }
 
 static void load_hl_symbols()
 {
+    static const symreq_t syms[] = {
+        {"PM_Move", &orig_hl_PM_Move, true},
+        {"PM_FlyMove", &orig_hl_PM_FlyMove, true},
+        {"PM_WalkMove", &orig_hl_PM_WalkMove, true},
+        {"_Z11GameDLLInitv", &orig_GameDLLInit, true},
+        {"_Z13AddToFullPackP14entity_state_siP7edict_sS2_iiPh",
+         &orig_AddToFullPack, true},
+        {"_Z14PlayerPreThinkP7edict_s", &orig_PlayerPreThink, true},
+        {"_Z14ServerActivateP7edict_sii", &orig_ServerActivate, true},
+        {"_ZN6CWorld8KeyValueEP14KeyValueData_s", &orig_CWorld_KeyValue, true},
+        {"_ZN11CBasePlayer10TakeDamageEP9entvars_sS1_fi",
+         &orig_CBasePlayer_TakeDamage, true},
+        {"_ZN6CGauss9StartFireEv", &orig_hl_CGauss_StartFire, true},
+        {"_ZN6CGauss13PrimaryAttackEv", &orig_hl_CGauss_PrimaryAttack, true},
+        {"_ZN17CBasePlayerWeapon13DefaultDeployEPcS0_iS0_ii",
+         &orig_hl_CBasePlayerWeapon_DefaultDeploy, true},
+        {"gpGlobals", &pp_gpGlobals, true},
+        {"g_ulFrameCount", &p_g_ulFrameCount, true},
+        {"g_onladder", &p_g_onladder, false},
+    };
+
     std::string hlso_fullpath;
     get_loaded_lib_info(HLSO_NAME, hlso_addr, hlso_fullpath);
     if (!hlso_addr)
         abort_with_err("Failed to get the base address of %s.", HLSO_NAME);
     hlso_st = get_symbols(hlso_fullpath.c_str());
-
-    orig_hl_PM_Move = (PM_Move_func_t)(hlso_addr + hlso_st["PM_Move"]);
-    orig_hl_PM_FlyMove = (PM_FlyMove_func_t)(hlso_addr + hlso_st["PM_FlyMove"]);
-    orig_hl_PM_WalkMove = (PM_WalkMove_func_t)(hlso_addr + hlso_st["PM_WalkMove"]);
-    orig_GameDLLInit = (GameDLLInit_func_t)(hlso_addr + hlso_st["_Z11GameDLLInitv"]);
-    orig_AddToFullPack = (AddToFullPack_func_t)(hlso_addr + hlso_st["_Z13AddToFullPackP14entity_state_siP7edict_sS2_iiPh"]);
-    orig_PlayerPreThink = (PlayerPreThink_func_t)(hlso_addr + hlso_st["_Z14PlayerPreThinkP7edict_s"]);
-    orig_CWorld_KeyValue = (CWorld_KeyValue_func_t)(hlso_addr + hlso_st["_ZN6CWorld8KeyValueEP14KeyValueData_s"]);
-    orig_CBasePlayer_TakeDamage = (CBasePlayer_TakeDamage_func_t)(hlso_addr + hlso_st["_ZN11CBasePlayer10TakeDamageEP9entvars_sS1_fi"]);
-    orig_hl_CGauss_StartFire = (CGauss_StartFire_func_t)(hlso_addr + hlso_st["_ZN6CGauss9StartFireEv"]);
-    orig_hl_CGauss_PrimaryAttack = (CGauss_PrimaryAttack_func_t)(hlso_addr + hlso_st["_ZN6CGauss13PrimaryAttackEv"]);
-    orig_hl_CBasePlayerWeapon_DefaultDeploy = (CBasePlayerWeapon_DefaultDeploy_func_t)(hlso_addr + hlso_st["_ZN17CBasePlayerWeapon13DefaultDeployEPcS0_iS0_ii"]);
-
-    pp_gpGlobals = (uintptr_t *)(hlso_addr + hlso_st["gpGlobals"]);
-    p_g_ulFrameCount = (unsigned int *)(hlso_addr + hlso_st["g_ulFrameCount"]);
-    p_g_onladder = (int *)(hlso_addr + hlso_st["g_onladder"]);
+    if (!resolve_symbols(HLSO_NAME, hlso_addr, hlso_st, syms))
+        abort_with_err("Failed to resolve the symbols needed from %s.",
+                       HLSO_NAME);
 }
 
 static void load_hw_symbols()
 {
+    static const symreq_t syms[] = {
+        {"Cvar_RegisterVariable", &orig_Cvar_RegisterVariable, true},
+        {"Cvar_SetValue", &orig_Cvar_SetValue, true},
+        {"Cmd_AddGameCommand", &orig_Cmd_AddGameCommand, true},
+        {"Cmd_Argv", &orig_Cmd_Argv, true},
+        {"Cmd_Argc", &orig_Cmd_Argc, true},
+        {"Cbuf_AddText", &orig_Cbuf_AddText, true},
+        {"SCR_UpdateScreen", &orig_SCR_UpdateScreen, true},
+        {"SV_SendClientMessages", &orig_SV_SendClientMessages, true},
+        {"SZ_GetSpace", &orig_SZ_GetSpace, true},
+        {"Con_Printf", &orig_Con_Printf, true},
+        {"com_gamedir", &gamedir, true},
+        {"host_frametime", &p_host_frametime, true},
+        {"sv_player", &pp_sv_player, true},
+        {"r_norefresh", &p_r_norefresh, true},
+        {"cmd_text", &p_cmd_text, false},
+    };
+
     std::string hwso_fullpath;
     get_loaded_lib_info("hw.so", hwso_addr, hwso_fullpath);
     if (!hwso_addr)
         abort_with_err("Failed to get the base address of hw.so.");
     hwso_st = get_symbols(hwso_fullpath.c_str());
-
-    orig_Cvar_RegisterVariable = (Cvar_RegisterVariable_func_t)(hwso_addr + hwso_st["Cvar_RegisterVariable"]);
-    orig_Cvar_SetValue = (Cvar_SetValue_func_t)(hwso_addr + hwso_st["Cvar_SetValue"]);
-    orig_Cmd_AddGameCommand = (Cmd_AddGameCommand_func_t)(hwso_addr + hwso_st["Cmd_AddGameCommand"]);
-    orig_Cmd_Argv = (Cmd_Argv_func_t)(hwso_addr + hwso_st["Cmd_Argv"]);
-    orig_SCR_UpdateScreen = (SCR_UpdateScreen_func_t)(hwso_addr + hwso_st["SCR_UpdateScreen"]);
-    orig_SV_SendClientMessages = (SV_SendClientMessages_func_t)(hwso_addr + hwso_st["SV_SendClientMessages"]);
-    orig_SZ_GetSpace = (SZ_GetSpace_func_t)(hwso_addr + hwso_st["SZ_GetSpace"]);
-    orig_Con_Printf = (Con_Printf_func_t)(hwso_addr + hwso_st["Con_Printf"]);
-
-    gamedir = (const char *)(hwso_addr + hwso_st["com_gamedir"]);
-    p_host_frametime = (double *)(hwso_addr + hwso_st["host_frametime"]);
-    pp_sv_player = (uintptr_t *)(hwso_addr + hwso_st["sv_player"]);
-    p_r_norefresh = (cvar_t *)(hwso_addr + hwso_st["r_norefresh"]);
+    if (!resolve_symbols("hw.so", hwso_addr, hwso_st, syms))
+        abort_with_err("Failed to resolve the symbols needed from hw.so.");
 }
 
 // Note that this function is called before GameDLLInit.
@@ -235,6 +308,31 @@ static void change_plr_ap()
     *(float *)(*pp_sv_player + 0x80 + 0x1bc) = std::atof(orig_Cmd_Argv(1));
 }
 
+static void tas_perf()
+{
+    tas_perf_cmd(orig_Cmd_Argv(1));
+}
+
+static void tas_branch()
+{
+    if (!p_cmd_text) {
+        orig_Con_Printf("tas_branch: cmd_text was not found in hw.so.\n");
+        return;
+    }
+    int argc = orig_Cmd_Argc();
+    std::vector<const char *> argv(argc);
+    for (int i = 0; i < argc; i++)
+        argv[i] = orig_Cmd_Argv(i);
+    const char *script = tas_branch_cmd(argc, argv.data());
+    if (!script)
+        return;
+    // The rest of the calling script is still in the command buffer, and is
+    // for the parent to carry on with, so a child starts from its own script
+    // alone.
+    *(int *)(p_cmd_text + 0x10) = 0;
+    orig_Cbuf_AddText(("exec " + std::string(script) + "\n").c_str());
+}
+
 void GameDLLInit()
 {
     if (!tas_hook_initialized) {
@@ -244,6 +342,8 @@ void GameDLLInit()
         load_hl_symbols();
         orig_Cmd_AddGameCommand("ch_health", change_plr_hp);
         orig_Cmd_AddGameCommand("ch_armor", change_plr_ap);
+        orig_Cmd_AddGameCommand("tas_perf", tas_perf);
+        orig_Cmd_AddGameCommand("tas_branch", tas_branch);
         tas_hook_initialized = true; // finally, everything is initialised
     }
     orig_GameDLLInit();
@@ -289,12 +389,36 @@ static void get_trigger_amt_colors(const char *type, int *amt, char colors[3])
     }
 }
 
+static const edictclass_t &get_edict_class(int e, uintptr_t entaddr)
+{
+    static edictclass_t uncached;
+    int serialnumber = *(int *)(entaddr + 0x4);
+    unsigned int classname = *(unsigned int *)(entaddr + 0x80);
+    edictclass_t &cls = e >= 0 && e < MAX_EDICTS ? edict_classes[e] : uncached;
+    if (cls.gen == edict_classes_gen && cls.serialnumber == serialnumber &&
+        cls.classname == classname)
+        return cls;
+
+    cls.gen = edict_classes_gen;
+    cls.serialnumber = serialnumber;
+    cls.classname = classname;
+    const char *name = hlname_to_string(classname);
+    cls.is_trigger = std::strncmp(name, "trigger_", 8) == 0;
+    if (cls.is_trigger)
+        get_trigger_amt_colors(name + 8, &cls.amt, cls.colors);
+    return cls;
+}
+
 int AddToFullPack(entity_state_s *state, int e, edict_s *ent, edict_s *host,
                   int hostflags, int player, unsigned char *pSet)
 {
+    perf_scope_t perf(PerfAddToFullPack);
+    if (!sv_show_triggers.value && !sv_show_hidents.value)
+        return orig_AddToFullPack(state, e, ent, host, hostflags, player, pSet);
+
     uintptr_t entvarsaddr = (uintptr_t)ent + 0x80;
-    const char *classname = hlname_to_string(*(unsigned int *)entvarsaddr);
-    bool is_trigger = std::strncmp(classname, "trigger_", 8) == 0;
+    const edictclass_t &cls = get_edict_class(e, (uintptr_t)ent);
+    bool is_trigger = cls.is_trigger;
 
     if ((!is_trigger || !sv_show_triggers.value) && !sv_show_hidents.value)
         return orig_AddToFullPack(state, e, ent, host, hostflags, player, pSet);
@@ -313,8 +437,9 @@ int AddToFullPack(entity_state_s *state, int e, edict_s *ent, edict_s *host,
         *(int *)(stateaddr + 0x3c) &= ~EF_NODRAW;
         *(int *)(stateaddr + 0x48) = kRenderTransColor;
         *(int *)(stateaddr + 0x54) = kRenderFxPulseFastWide;
-        get_trigger_amt_colors(classname + 8, (int *)(stateaddr + 0x4c),
-                               (char *)(stateaddr + 0x50));
+        *(int *)(stateaddr + 0x4c) = cls.amt;
+        std::memcpy((char *)(stateaddr + 0x50), cls.colors,
+                    sizeof(cls.colors));
     } else if (sv_show_hidents.value) {
         *(int *)(stateaddr + 0x3c) &= ~EF_NODRAW;
         *(int *)(stateaddr + 0x48) = kRenderNormal;
@@ -323,26 +448,67 @@ int AddToFullPack(entity_state_s *state, int e, edict_s *ent, edict_s *host,
     return 1;
 }
 
+void ServerActivate(edict_s *edicts, int edict_count, int client_max)
+{
+    server_gen++;
+    orig_ServerActivate(edicts, edict_count, client_max);
+}
+
 void PlayerPreThink(edict_s *ent)
 {
-    if (sv_taslog.value) {
-        orig_Con_Printf("prethink %u %.8g\n", *p_g_ulFrameCount,
-                        *(float *)(*pp_gpGlobals + 0x4));
-        orig_Con_Printf("health %.8g %.8g\n",
-                        *(float *)((uintptr_t)ent + 0x80 + 0x160),
-                        *(float *)((uintptr_t)ent + 0x80 + 0x1bc));
+    perf_scope_t perf(PerfPlayerPreThink);
+    unsigned int channels = taslog_channels();
+    if (!(channels & TASLOG_PRETHINK_CHANNELS)) {
+        orig_PlayerPreThink(ent);
+        return;
+    }
+
+    if (sv_taslog.value == 2) {
+        taslog_prethink_t rec;
+        rec.frameno = *p_g_ulFrameCount;
+        rec.frametime = *(float *)(*pp_gpGlobals + 0x4);
+        rec.health = *(float *)((uintptr_t)ent + 0x80 + 0x160);
+        rec.armor = *(float *)((uintptr_t)ent + 0x80 + 0x1bc);
+        taslog_write(rec, RecPrethink);
+    } else {
+        if (channels & ChanPrethink)
+            orig_Con_Printf("prethink %u %.8g\n", *p_g_ulFrameCount,
+                            *(float *)(*pp_gpGlobals + 0x4));
+        if (channels & ChanHealth)
+            orig_Con_Printf("health %.8g %.8g\n",
+                            *(float *)((uintptr_t)ent + 0x80 + 0x160),
+                            *(float *)((uintptr_t)ent + 0x80 + 0x1bc));
     }
     orig_PlayerPreThink(ent);
 }
 
 extern "C" void SV_SendClientMessages()
 {
-    if (p_r_norefresh->value <= 2)
+    if (p_r_norefresh->value <= 2 && !sv_tas_turbo.value)
         orig_SV_SendClientMessages();
 }
 
+static bool is_turbo_sink(uintptr_t buf)
+{
+    for (int i = 0; i < num_turbo_sinks; i++)
+        if (turbo_sinks[i] == buf)
+            return true;
+    return false;
+}
+
 extern "C" uintptr_t SZ_GetSpace(uintptr_t buf, int len)
 {
+    if (sv_tas_turbo.value && len <= (int)sizeof(turbo_scratch)) {
+        if (is_turbo_sink(buf))
+            return (uintptr_t)turbo_scratch;
+        if (*(int *)(buf + 0x10) + len > *(int *)(buf + 0xc) &&
+            num_turbo_sinks < MAX_TURBO_SINKS) {
+            turbo_sinks[num_turbo_sinks++] = buf;
+            *(int *)(buf + 0x10) = 0;
+            return (uintptr_t)turbo_scratch;
+        }
+    }
+
     if (p_r_norefresh->value > 2 &&
         *(int *)(buf + 0x10) + len > *(int *)(buf + 0xc)) {
         *(int *)(buf + 0x10) = 0;
@@ -350,9 +516,45 @@ extern "C" uintptr_t SZ_GetSpace(uintptr_t buf, int len)
     return orig_SZ_GetSpace(buf, len);
 }
 
+// Count the frames run in turbo mode, keep sv_tas_turbo_fps up to date, and
+// print the frame rate achieved once turbo mode is turned off.
+static void update_turbo_stats()
+{
+    auto now = std::chrono::steady_clock::now();
+    if (!sv_tas_turbo.value) {
+        if (!turbo_on)
+            return;
+        turbo_on = false;
+        num_turbo_sinks = 0;
+        std::chrono::duration<double> elapsed = now - turbo_start;
+        orig_Con_Printf("turbo: %lu frames in %.3f s (%.0f frames/s)\n",
+                        turbo_frames, elapsed.count(),
+                        turbo_frames / elapsed.count());
+        return;
+    }
+
+    if (!turbo_on) {
+        turbo_on = true;
+        turbo_frames = turbo_window_frames = 0;
+        turbo_start = turbo_window_start = now;
+    }
+    turbo_frames++;
+    turbo_window_frames++;
+    std::chrono::duration<double> elapsed = now - turbo_window_start;
+    if (elapsed.count() >= 1) {
+        orig_Cvar_SetValue("sv_tas_turbo_fps",
+                           turbo_window_frames / elapsed.count());
+        turbo_window_frames = 0;
+        turbo_window_start = now;
+    }
+}
+
 extern "C" void SCR_UpdateScreen()
 {
-    if (p_r_norefresh->value <= 1)
+    perf_scope_t perf(PerfSCR_UpdateScreen);
+    update_turbo_stats();
+    tas_branch_frame();
+    if (p_r_norefresh->value <= 1 && !sv_tas_turbo.value)
         orig_SCR_UpdateScreen();
 }
 
@@ -375,6 +577,30 @@ extern "C" void Cvar_Init()
     sv_taslog.string = "0";
     orig_Cvar_RegisterVariable(&sv_taslog);
 
+    sv_taslog_channels.name = "sv_taslog_channels";
+    sv_taslog_channels.string = "2047";
+    orig_Cvar_RegisterVariable(&sv_taslog_channels);
+
+    sv_taslog_dropped.name = "sv_taslog_dropped";
+    sv_taslog_dropped.string = "0";
+    orig_Cvar_RegisterVariable(&sv_taslog_dropped);
+
+    sv_tas_turbo.name = "sv_tas_turbo";
+    sv_tas_turbo.string = "0";
+    orig_Cvar_RegisterVariable(&sv_tas_turbo);
+
+    sv_tas_turbo_fps.name = "sv_tas_turbo_fps";
+    sv_tas_turbo_fps.string = "0";
+    orig_Cvar_RegisterVariable(&sv_tas_turbo_fps);
+
+    sv_tas_branch_timeout.name = "sv_tas_branch_timeout";
+    sv_tas_branch_timeout.string = "60";
+    orig_Cvar_RegisterVariable(&sv_tas_branch_timeout);
+
+    sv_tas_perf.name = "sv_tas_perf";
+    sv_tas_perf.string = "0";
+    orig_Cvar_RegisterVariable(&sv_tas_perf);
+
     sv_sim_qg.name = "sv_sim_qg";
     sv_sim_qg.string = "0";
     orig_Cvar_RegisterVariable(&sv_sim_qg);
@@ -388,29 +614,91 @@ extern "C" void Cvar_Init()
     orig_Cvar_RegisterVariable(&sv_sim_grf);
 }
 
+static void write_tasinfo(uintptr_t pmove, int num, unsigned int channels)
+{
+    float *pos = (float *)(pmove + 0x38);
+    float *vel = (float *)(pmove + 0x5c);
+    float *basevel = (float *)(pmove + 0x74);
+
+    if (num == 1 && channels & TASLOG_PMOVE_PRE_CHANNELS) {
+        uintptr_t cmd = pmove + 0x45458;
+        taslog_pmove_pre_t rec;
+        rec.msec = *(unsigned char *)(cmd + 0x2);
+        rec.buttons = *(unsigned short *)(cmd + 0x1e);
+        rec.pitch = *(float *)(cmd + 0x4);
+        rec.yaw = *(float *)(cmd + 0x8);
+        for (int i = 0; i < 3; i++) {
+            rec.fsu[i] = *(float *)(cmd + 0x10 + 4 * i);
+            rec.pos[i] = pos[i];
+            rec.vel[i] = vel[i];
+            rec.basevel[i] = basevel[i];
+        }
+        rec.friction = *(float *)(pmove + 0xc4);
+        rec.gravity = *(float *)(pmove + 0xc0);
+        rec.punchangle[0] = *(float *)(pmove + 0xa0);
+        rec.punchangle[1] = *(float *)(pmove + 0xa4);
+        rec.induck = *(int *)(pmove + 0x90);
+        rec.flags = *(unsigned int *)(pmove + 0xb8);
+        rec.onground = *(int *)(pmove + 0xe0);
+        rec.waterlevel = *(int *)(pmove + 0xe4);
+        taslog_write(rec, RecPmovePre);
+    } else if (num == 2 && channels & TASLOG_PMOVE_POST_CHANNELS) {
+        taslog_pmove_post_t rec;
+        rec.numtouch = mvmt_clipped;
+        rec.ladder = p_g_onladder ? *p_g_onladder : 0;
+        for (int i = 0; i < 3; i++) {
+            rec.pos[i] = pos[i];
+            rec.vel[i] = vel[i];
+            rec.basevel[i] = basevel[i];
+        }
+        rec.induck = *(int *)(pmove + 0x90);
+        rec.flags = *(unsigned int *)(pmove + 0xb8);
+        rec.onground = *(int *)(pmove + 0xe0);
+        rec.waterlevel = *(int *)(pmove + 0xe4);
+        taslog_write(rec, RecPmovePost);
+    }
+}
+
 static void print_tasinfo(uintptr_t pmove, int server, int num)
 {
-    if (!server || !sv_taslog.value)
+    unsigned int channels = taslog_channels();
+    if (!server || !channels)
+        return;
+
+    if (sv_taslog.value == 2) {
+        write_tasinfo(pmove, num, channels);
         return;
+    }
 
     if (num == 1) {
         uintptr_t cmd = pmove + 0x45458;
-        orig_Con_Printf("usercmd %d %u %.8g %.8g\n",
-                        *(char *)(cmd + 0x2), *(unsigned short *)(cmd + 0x1e),
-                        *(float *)(cmd + 0x4), *(float *)(cmd + 0x8));
-        orig_Con_Printf("fsu %.8g %.8g %.8g\n",
-                        *(float *)(cmd + 0x10), *(float *)(cmd + 0x14),
-                        *(float *)(cmd + 0x18));
-        orig_Con_Printf("fg %.8g %.8g\n", *(float *)(pmove + 0xc4),
-                        *(float *)(pmove + 0xc0));
-        orig_Con_Printf("pa %.8g %.8g\n", *(float *)(pmove + 0xa0),
-                        *(float *)(pmove + 0xa4));
-    } else if (num == 2)
-        orig_Con_Printf("ntl %d %d\n", mvmt_clipped, *p_g_onladder);
-
-    float *pos = (float *)(pmove + 0x38);
-    orig_Con_Printf("pos %d %.8g %.8g %.8g\n", num, pos[0], pos[1], pos[2]);
+        if (channels & ChanUsercmd)
+            orig_Con_Printf("usercmd %d %u %.8g %.8g\n",
+                            *(char *)(cmd + 0x2),
+                            *(unsigned short *)(cmd + 0x1e),
+                            *(float *)(cmd + 0x4), *(float *)(cmd + 0x8));
+        if (channels & ChanFsu)
+            orig_Con_Printf("fsu %.8g %.8g %.8g\n",
+                            *(float *)(cmd + 0x10), *(float *)(cmd + 0x14),
+                            *(float *)(cmd + 0x18));
+        if (channels & ChanFg)
+            orig_Con_Printf("fg %.8g %.8g\n", *(float *)(pmove + 0xc4),
+                            *(float *)(pmove + 0xc0));
+        if (channels & ChanPa)
+            orig_Con_Printf("pa %.8g %.8g\n", *(float *)(pmove + 0xa0),
+                            *(float *)(pmove + 0xa4));
+    } else if (num == 2 && channels & ChanNtl)
+        orig_Con_Printf("ntl %d %d\n", mvmt_clipped,
+                        p_g_onladder ? *p_g_onladder : 0);
+
+    if (channels & ChanPos) {
+        float *pos = (float *)(pmove + 0x38);
+        orig_Con_Printf("pos %d %.8g %.8g %.8g\n", num, pos[0], pos[1],
+                        pos[2]);
+    }
 
+    if (!(channels & ChanPmove))
+        return;
     float *vel = (float *)(pmove + 0x5c);
     float *basevel = (float *)(pmove + 0x74);
     orig_Con_Printf("pmove %d %.8g %.8g %.8g %.8g %.8g %.8g %d %u %d %d\n",
@@ -422,8 +710,14 @@ static void print_tasinfo(uintptr_t pmove, int server, int num)
 
 extern "C" void PM_Move(uintptr_t ppmove, int server)
 {
+    perf_scope_t perf(PerfPM_Move);
+    // The client's prediction of the player only matters for what is drawn.
+    if (!server && sv_tas_turbo.value)
+        return;
     p_pmove = ppmove;
     mvmt_clipped = false;
+    if (server)
+        sync_movement_msec(*(unsigned char *)(ppmove + 0x45458 + 0x2));
     print_tasinfo(ppmove, server, 1);
     (server ? orig_hl_PM_Move : orig_cl_PM_Move)(ppmove, server);
     print_tasinfo(ppmove, server, 2);
@@ -431,6 +725,7 @@ extern "C" void PM_Move(uintptr_t ppmove, int server)
 
 extern "C" int PM_FlyMove()
 {
+    perf_scope_t perf(PerfPM_FlyMove);
     if (!*(int *)(p_pmove + 0x4))
         return orig_cl_PM_FlyMove();
 
@@ -456,6 +751,7 @@ extern "C" int PM_FlyMove()
 
 extern "C" void PM_WalkMove()
 {
+    perf_scope_t perf(PerfPM_WalkMove);
     if (!*(int *)(p_pmove + 0x4)) {
         orig_cl_PM_WalkMove();
         return;
@@ -483,6 +779,9 @@ extern "C" void PM_WalkMove()
 
 void CWorld::KeyValue(KeyValueData_s *keydat)
 {
+    // A new map is being loaded, whose entities have nothing to do with
+    // those of the last one.
+    edict_classes_gen++;
     char *keystr = *(char **)((uintptr_t)keydat + 4);
     if (strcmp(keystr, "startdark") == 0)
         return;
@@ -492,8 +791,15 @@ void CWorld::KeyValue(KeyValueData_s *keydat)
 int CBasePlayer::TakeDamage(entvars_s *pevInflictor, entvars_s *pevAttacker,
                             float flDamage, int bitsDamageType)
 {
-    if (sv_taslog.value)
-        orig_Con_Printf("dmg %.8g %d\n", flDamage, bitsDamageType);
+    if (taslog_channels() & ChanDamage) {
+        if (sv_taslog.value == 2) {
+            taslog_damage_t rec;
+            rec.damage = flDamage;
+            rec.bits = bitsDamageType;
+            taslog_write(rec, RecDamage);
+        } else
+            orig_Con_Printf("dmg %.8g %d\n", flDamage, bitsDamageType);
+    }
     return orig_CBasePlayer_TakeDamage(this, pevInflictor, pevAttacker,
                                        flDamage, bitsDamageType);
 }
@@ -560,18 +866,25 @@ extern "C" void *dlsym(void *handle, const char *symbol)
     return orig_dlsym(handle, symbol);
 }
 
+static bool load_dlsym(const char *libname)
+{
+    static const symreq_t syms[] = {
+        {"dlsym", &orig_dlsym, true},
+    };
+
+    std::string fullpath;
+    uintptr_t addr;
+    get_loaded_lib_info(libname, addr, fullpath);
+    if (!addr)
+        return false;
+    symtbl_t st = get_symbols(fullpath.c_str());
+    return resolve_symbols(libname, addr, st, syms);
+}
+
 static __attribute__((constructor)) void Constructor()
 {
-    std::string libdl_fullpath;
-    uintptr_t libdl_addr;
-    symtbl_t libdl_symbols;
-    get_loaded_lib_info("libdl.so.2", libdl_addr, libdl_fullpath);
-    libdl_symbols = get_symbols(libdl_fullpath.c_str());
-    for (auto it = libdl_symbols.begin(); it != libdl_symbols.end(); ++it) {
-        if (std::strncmp(it->first.c_str(), "dlsym", 5) == 0) {
-            orig_dlsym = (dlsym_func_t)(libdl_addr + it->second);
-            break;
-        }
-    }
+    // Since glibc 2.34 libdl.so.2 is an empty stub and dlsym is in libc.
+    if (!load_dlsym("libdl.so.2") && !load_dlsym("libc.so.6"))
+        abort_with_err("Failed to resolve dlsym.");
 }
 #endif
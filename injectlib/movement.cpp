@@ -1,8 +1,12 @@
 #include <cstdio>
 #include <cmath>
+#include <cstring>
 #include "common.hpp"
+#include "frametime.hpp"
 #include "movement.hpp"
 #include "strafemath.hpp"
+#include "taslog.hpp"
+#include "tasperf.hpp"
 
 enum position_t
 {
@@ -45,6 +49,14 @@ struct kbutton_t
     int state;
 };
 
+struct tracecache_t
+{
+    float start[3];
+    float end[3];
+    int usehull;
+    pmtrace_t trace;
+};
+
 struct tascmd_t
 {
     double value;
@@ -111,6 +123,7 @@ static cvar_t **pp_cl_upspeed = nullptr;
 static cvar_t *cl_db4c_ceil = nullptr;
 static cvar_t *cl_lgagst_origM = nullptr;
 static cvar_t *cl_mtype = nullptr;
+static cvar_t *cl_tas_lookahead = nullptr;
 
 // 0 to do nothing, 1 to mean +jump or +duck, and 2 to mean -jump or -duck.
 static int jump_action = 0;
@@ -136,8 +149,26 @@ static moveaction_t g_moveaction = StrafeNone;
 static double line_origin[2];
 static double line_dir[2];
 static float prev_unitvel[2];
+static frametime_acc_t frametime_acc;
 
 static const double TAS_FSU_MAG = 10000;
+static const int MAX_LOOKAHEAD = 64;
+
+// Traces made while deciding one frame's actions.  Nothing moves between them,
+// so the same start, end and hull always give the same result.
+static const int TRACE_CACHE_SIZE = 16;
+static tracecache_t trace_cache[TRACE_CACHE_SIZE];
+static int trace_cache_len = 0;
+static int trace_cache_next = 0;
+static unsigned int trace_cache_hits = 0;
+static unsigned int trace_cache_misses = 0;
+
+static void IN_TasTraceStats()
+{
+    orig_Con_Printf("trace cache: %u hits, %u misses\n", trace_cache_hits,
+                    trace_cache_misses);
+    trace_cache_hits = trace_cache_misses = 0;
+}
 
 static void IN_TasSetYaw()
 {
@@ -259,6 +290,53 @@ static inline int get_duckstate()
     return 0;
 }
 
+static inline int get_usehull()
+{
+    return *(int *)(*pp_hwpmove + 0xbc);
+}
+
+static void clear_trace_cache()
+{
+    trace_cache_len = 0;
+    trace_cache_next = 0;
+}
+
+// PM_PlayerTrace with the given hull, going through the trace cache.
+static pmtrace_t player_trace(const float start[3], const float end[3],
+                              int usehull)
+{
+    for (int i = 0; i < trace_cache_len; i++) {
+        const tracecache_t &ent = trace_cache[i];
+        if (ent.usehull == usehull &&
+            std::memcmp(ent.start, start, sizeof(ent.start)) == 0 &&
+            std::memcmp(ent.end, end, sizeof(ent.end)) == 0) {
+            trace_cache_hits++;
+            return ent.trace;
+        }
+    }
+    trace_cache_misses++;
+
+    tracecache_t &ent = trace_cache[trace_cache_next];
+    std::memcpy(ent.start, start, sizeof(ent.start));
+    std::memcpy(ent.end, end, sizeof(ent.end));
+    ent.usehull = usehull;
+
+    int *p_usehull = (int *)(*pp_hwpmove + 0xbc);
+    int old_usehull = *p_usehull;
+    *p_usehull = usehull;
+    // The engine takes non-const pointers but does not write through them.
+    {
+        perf_scope_t perf(PerfPlayerTrace);
+        ent.trace = orig_PM_PlayerTrace(ent.start, ent.end, 0, -1);
+    }
+    *p_usehull = old_usehull;
+
+    trace_cache_next = (trace_cache_next + 1) % TRACE_CACHE_SIZE;
+    if (trace_cache_len < TRACE_CACHE_SIZE)
+        trace_cache_len++;
+    return ent.trace;
+}
+
 static float get_fric_coef(const double vel[3], const double pos[3])
 {
     // Return 0 because this is roughly similar to what PM_Friction does.
@@ -273,9 +351,9 @@ static float get_fric_coef(const double vel[3], const double pos[3])
 
     start[0] = end[0] = pos[0] + vel[0] / speed * 16;
     start[1] = end[1] = pos[1] + vel[1] / speed * 16;
-    start[2] = pos[2] + player_mins[*(int *)(*pp_hwpmove + 0xbc)][2];
+    start[2] = pos[2] + player_mins[get_usehull()][2];
     end[2] = start[2] - 34;
-    pmtrace_t trace = orig_PM_PlayerTrace(start, end, 0, -1);
+    pmtrace_t trace = player_trace(start, end, get_usehull());
     if (trace.fraction == 1)
         k *= *(float *)(p_movevars + 0x20); // edgefriction
 
@@ -312,11 +390,7 @@ static bool is_unduckable(const playerinfo_t &plrinfo)
                        (float)plrinfo.pos[2]};
     if (plrinfo.postype == PositionGround)
         target[2] += 18;
-    int *p_usehull = (int *)(*pp_hwpmove + 0xbc);
-    int old_usehull = *p_usehull;
-    *p_usehull = 0;
-    pmtrace_t trace = orig_PM_PlayerTrace(target, target, 0, -1);
-    *p_usehull = old_usehull;
+    pmtrace_t trace = player_trace(target, target, 0);
     return !trace.startsolid;
 }
 
@@ -385,12 +459,7 @@ static bool is_ground_below(const double pos[3], int usehull,
 
     pmtrace_t mytrace;
     pmtrace_t *p_trace = trace ? trace : &mytrace;
-
-    int *p_usehull = (int *)(*pp_hwpmove + 0xbc);
-    int old_usehull = *p_usehull;
-    *p_usehull = usehull;
-    *p_trace = orig_PM_PlayerTrace(start, end, 0, -1);
-    *p_usehull = old_usehull;
+    *p_trace = player_trace(start, end, usehull);
     if (p_trace->plane.normal[2] < 0.7)
         return false;
     return true;
@@ -406,7 +475,7 @@ static void categorize_pos(playerinfo_t &plrinfo)
     }
 
     pmtrace_t trace;
-    if (!is_ground_below(plrinfo.pos, *(int *)(*pp_hwpmove + 0xbc), &trace)) {
+    if (!is_ground_below(plrinfo.pos, get_usehull(), &trace)) {
         plrinfo.postype = PositionAir;
         return;
     }
@@ -419,8 +488,7 @@ static void categorize_pos(playerinfo_t &plrinfo)
 
 static void load_player_state(playerinfo_t &plrinfo)
 {
-    // FIXME: this is not correct when it is not a multiple of 0.001!
-    plrinfo.tau = *p_host_frametime;
+    plrinfo.tau = frametime_acc.next(*p_host_frametime) / 1000.0;
     plrinfo.M = *(float *)(p_movevars + 0x8);
     if (get_duckstate() == 2)
         plrinfo.M *= 0.333;
@@ -496,16 +564,9 @@ static void add_correct_gravity(playerinfo_t &plrinfo)
     plrinfo.basevel[2] = 0;
 }
 
-static void do_strafe_none(playerinfo_t &plrinfo)
+// Accelerate plrinfo with the movement keys held by the user.
+static void strafe_none(playerinfo_t &plrinfo)
 {
-    if (g_old_moveaction != StrafeNone) {
-        // We were strafing in the previous frame but not in this frame, so
-        // let's release the keys.
-        orig_IN_BackUp();
-        orig_IN_MoveleftUp();
-        orig_IN_MoverightUp();
-    }
-
     double avec[2];
     double F, S, U;
     F = (p_in_forward->state & 1) - (p_in_back->state & 1);
@@ -526,15 +587,29 @@ static void do_strafe_none(playerinfo_t &plrinfo)
                    plrinfo.tau * plrinfo.M * plrinfo.A);
 }
 
-static void do_strafe_tas(playerinfo_t &plrinfo)
+static void do_strafe_none(playerinfo_t &plrinfo)
+{
+    if (g_old_moveaction != StrafeNone) {
+        // We were strafing in the previous frame but not in this frame, so
+        // let's release the keys.
+        orig_IN_BackUp();
+        orig_IN_MoveleftUp();
+        orig_IN_MoverightUp();
+    }
+
+    strafe_none(plrinfo);
+}
+
+// Work out the strafing keys and yaw for this frame and accelerate plrinfo
+// with them, without pressing the keys.
+static void strafe_tas(playerinfo_t &plrinfo, int &Sdir, int &Fdir)
 {
     double yaw = plrinfo.viewangles[1] * M_PI / 180;
     double tauMA = plrinfo.tau * plrinfo.M * plrinfo.A;
-    int Sdir = 0, Fdir = 0;
+    Sdir = Fdir = 0;
 
     // Do the strafing!
     if (g_moveaction == StrafeLine) {
-        update_line(plrinfo);
         strafe_line_opt(yaw, Sdir, Fdir, plrinfo.vel, plrinfo.pos, plrinfo.L,
                         plrinfo.tau, plrinfo.M * plrinfo.A,
                         line_origin, line_dir);
@@ -550,6 +625,17 @@ static void do_strafe_tas(playerinfo_t &plrinfo)
         strafe_back(yaw, Sdir, Fdir, plrinfo.vel, tauMA);
     }
 
+    plrinfo.viewangles[1] = yaw * 180 / M_PI;
+}
+
+static void do_strafe_tas(playerinfo_t &plrinfo)
+{
+    if (g_moveaction == StrafeLine)
+        update_line(plrinfo);
+
+    int Sdir, Fdir;
+    strafe_tas(plrinfo, Sdir, Fdir);
+
     if (Sdir > 0) {
         orig_IN_MoverightDown();
         orig_IN_MoveleftUp();
@@ -569,8 +655,6 @@ static void do_strafe_tas(playerinfo_t &plrinfo)
     } else {
         orig_IN_BackUp();
     }
-
-    plrinfo.viewangles[1] = yaw * 180 / M_PI;
 }
 
 static void update_position(playerinfo_t &plrinfo)
@@ -694,6 +778,68 @@ static void do_movements(playerinfo_t &plrinfo, bool unduckable_onto_ground)
     do_tassba(plrinfo);
 }
 
+static bool hit_ground(const double start[3], const double end[3], int usehull)
+{
+    float startf[3], endf[3];
+    for (int i = 0; i < 3; i++) {
+        startf[i] = start[i];
+        endf[i] = end[i];
+    }
+    pmtrace_t tr = player_trace(startf, endf, usehull);
+    return (tr.fraction < 1 && tr.plane.normal[2] >= 0.7) ||
+        is_ground_below(end, usehull);
+}
+
+// Move plrinfo, just moved by do_movements or by an earlier call, through one
+// more airborne frame of the current strafing.  No keys are pressed and none
+// of the strafing state is changed, so this only looks at what will happen.
+static void predict_air_frame(playerinfo_t &plrinfo, frametime_acc_t &acc)
+{
+    // The second half of the gravity of the last frame, which PM_PlayerMove
+    // adds after moving the player.
+    float ent_grav = *(float *)(*pp_sv_player + 0x80 + 0x11c);
+    if (!ent_grav)
+        ent_grav = 1;
+    plrinfo.vel[2] -= ent_grav * *(float *)p_movevars * 0.5 * plrinfo.tau;
+
+    plrinfo.tau = acc.next(*p_host_frametime) / 1000.0;
+    plrinfo.M = *(float *)(p_movevars + 0x8);
+    plrinfo.postype = PositionAir;
+    load_player_movevars(plrinfo);
+    add_correct_gravity(plrinfo);
+
+    if (g_moveaction == StrafeNone) {
+        strafe_none(plrinfo);
+    } else {
+        int Sdir, Fdir;
+        strafe_tas(plrinfo, Sdir, Fdir);
+    }
+    update_position(plrinfo);
+}
+
+static int get_lookahead()
+{
+    int lookahead = (int)cl_tas_lookahead->value;
+    if (lookahead > MAX_LOOKAHEAD)
+        return MAX_LOOKAHEAD;
+    return lookahead;
+}
+
+// Whether the standing player lands within cl_tas_lookahead frames from now,
+// though not in this frame.  plrinfo is the player moved through this frame.
+static bool landing_ahead(const playerinfo_t &plrinfo)
+{
+    playerinfo_t ahead = plrinfo;
+    frametime_acc_t acc = frametime_acc;
+    for (int i = 1; i < get_lookahead(); i++) {
+        double prevpos[3] = {ahead.pos[0], ahead.pos[1], ahead.pos[2]};
+        predict_air_frame(ahead, acc);
+        if (hit_ground(prevpos, ahead.pos, 0))
+            return true;
+    }
+    return false;
+}
+
 static bool do_tasjumpbug(playerinfo_t &plrinfo, bool unduckable_onto_ground, bool &updated)
 {
     if (!tas_jb || plrinfo.postype == PositionGround || plrinfo.vel[2] > 180)
@@ -720,22 +866,6 @@ static bool do_tasjumpbug(playerinfo_t &plrinfo, bool unduckable_onto_ground, bo
     return false;
 }
 
-static bool hit_ground(const double start[3], const double end[3], int usehull)
-{
-    float startf[3], endf[3];
-    for (int i = 0; i < 3; i++) {
-        startf[i] = start[i];
-        endf[i] = end[i];
-    }
-    int *p_usehull = (int *)(*pp_hwpmove + 0xbc);
-    int old_usehull = *p_usehull;
-    *p_usehull = usehull;
-    pmtrace_t tr = orig_PM_PlayerTrace(startf, endf, 0, -1);
-    *p_usehull = old_usehull;
-    return (tr.fraction < 1 && tr.plane.normal[2] >= 0.7) ||
-        is_ground_below(end, usehull);
-}
-
 static bool do_tasdb4l(playerinfo_t &plrinfo, const playerinfo_t &old_plrinfo,
                        bool unduckable_onto_ground, bool &updated)
 {
@@ -779,7 +909,10 @@ static bool do_tasdb4l(playerinfo_t &plrinfo, const playerinfo_t &old_plrinfo,
             updated = true;
         }
 
-        if (hit_ground(old_plrinfo.pos, plrinfo.pos, 0)) {
+        // Stay ducked rather than unduck only to duck again a few frames
+        // later, by which time the count may have run out.
+        if (hit_ground(old_plrinfo.pos, plrinfo.pos, 0) ||
+            landing_ahead(plrinfo)) {
             db4l_state = 1;
             duck_action = 1;
             return true;
@@ -811,16 +944,12 @@ static bool do_tasdb4c(playerinfo_t &plrinfo, const playerinfo_t &old_plrinfo,
     float end[3] = {(float)plrinfo.pos[0], (float)plrinfo.pos[1],
                     (float)plrinfo.pos[2]};
 
-    pmtrace_t tr = orig_PM_PlayerTrace(start, end, 0, -1);
+    pmtrace_t tr = player_trace(start, end, get_usehull());
     if (tr.fraction == 1 || tr.plane.normal[2] >= 0.7 ||
         (!cl_db4c_ceil->value && tr.plane.normal[2] == -1))
         return false;
 
-    int *p_usehull = (int *)(*pp_hwpmove + 0xbc);
-    int old_usehull = *p_usehull;
-    *p_usehull = 1;
-    tr = orig_PM_PlayerTrace(start, end, 0, -1);
-    *p_usehull = old_usehull;
+    tr = player_trace(start, end, 1);
     if (tr.fraction != 1)
         return false;
 
@@ -832,6 +961,7 @@ static bool do_tasdb4c(playerinfo_t &plrinfo, const playerinfo_t &old_plrinfo,
 static void do_tas_actions()
 {
     playerinfo_t plrinfo;
+    clear_trace_cache();
     load_player_state(plrinfo);
 
     // Calling this function here corresponds to the first
@@ -863,6 +993,7 @@ final:
 
 extern "C" void CL_CreateMove(float frametime, void *cmd, int active)
 {
+    perf_scope_t perf(PerfCL_CreateMove);
     int *p_usehull = (int *)(*pp_hwpmove + 0xbc);
     int old_usehull = *p_usehull;
     if (get_duckstate() == 0 || get_duckstate() == 1)
@@ -870,8 +1001,9 @@ extern "C" void CL_CreateMove(float frametime, void *cmd, int active)
     else
         *p_usehull = 1;
 
+    bool log_yawspeed = taslog_channels() & ChanYawspeed;
     float viewangles[3];
-    if (sv_taslog.value)
+    if (log_yawspeed)
         orig_GetViewAngles(viewangles);
 
     // We don't really need Cvar_SetValue as these are only meant to trick
@@ -905,60 +1037,78 @@ extern "C" void CL_CreateMove(float frametime, void *cmd, int active)
 
     orig_CL_CreateMove(frametime, cmd, active);
 
-    if (sv_taslog.value) {
+    if (log_yawspeed) {
         float new_viewangles[3];
         orig_GetViewAngles(new_viewangles);
-        orig_Con_Printf("cl_yawspeed %.8g\n",
-                        (new_viewangles[1] - viewangles[1] + M_U_DEG / 2) /
-                        frametime);
+        double yawspeed = (new_viewangles[1] - viewangles[1] + M_U_DEG / 2) /
+            frametime;
+        if (sv_taslog.value == 2) {
+            taslog_yawspeed_t rec;
+            rec.yawspeed = yawspeed;
+            taslog_write(rec, RecYawspeed);
+        } else
+            orig_Con_Printf("cl_yawspeed %.8g\n", yawspeed);
     }
 
     *p_usehull = old_usehull;
 }
 
+void sync_movement_msec(int msec)
+{
+    frametime_acc.sync(msec);
+}
+
 void initialize_movement(uintptr_t clso_addr, const symtbl_t &clso_st,
                          uintptr_t hwso_addr, const symtbl_t &hwso_st)
 {
-    p_gEngfuncs = (uintptr_t)(clso_addr + clso_st.at("gEngfuncs"));
-    p_movevars = (uintptr_t)(hwso_addr + hwso_st.at("movevars"));
-    pp_hwpmove = (uintptr_t *)(hwso_addr + hwso_st.at("pmove"));
+    static const symreq_t clso_syms[] = {
+        {"gEngfuncs", &p_gEngfuncs, true},
+        {"CL_CreateMove", &orig_CL_CreateMove, true},
+        {"_Z11IN_BackDownv", &orig_IN_BackDown, true},
+        {"_Z9IN_BackUpv", &orig_IN_BackUp, true},
+        {"_Z15IN_MoveleftDownv", &orig_IN_MoveleftDown, true},
+        {"_Z13IN_MoveleftUpv", &orig_IN_MoveleftUp, true},
+        {"_Z16IN_MoverightDownv", &orig_IN_MoverightDown, true},
+        {"_Z14IN_MoverightUpv", &orig_IN_MoverightUp, true},
+        {"_Z11IN_DuckDownv", &orig_IN_DuckDown, true},
+        {"_Z9IN_DuckUpv", &orig_IN_DuckUp, true},
+        {"_Z11IN_JumpDownv", &orig_IN_JumpDown, true},
+        {"_Z9IN_JumpUpv", &orig_IN_JumpUp, true},
+        {"in_duck", &p_in_duck, true},
+        {"in_jump", &p_in_jump, true},
+        {"in_forward", &p_in_forward, true},
+        {"in_back", &p_in_back, true},
+        {"in_moveright", &p_in_moveright, true},
+        {"in_moveleft", &p_in_moveleft, true},
+        {"in_up", &p_in_up, true},
+        {"in_down", &p_in_down, true},
+        {"cl_forwardspeed", &pp_cl_forwardspeed, true},
+        {"cl_sidespeed", &pp_cl_sidespeed, true},
+        {"cl_backspeed", &pp_cl_backspeed, true},
+        {"cl_upspeed", &pp_cl_upspeed, true},
+    };
+    static const symreq_t hwso_syms[] = {
+        {"movevars", &p_movevars, true},
+        {"pmove", &pp_hwpmove, true},
+        {"Cbuf_InsertTextLines", &orig_Cbuf_InsertTextLines, true},
+        {"PM_PlayerTrace", &orig_PM_PlayerTrace, true},
+    };
+
+    if (!resolve_symbols("client.so", clso_addr, clso_st, clso_syms))
+        abort_with_err("Failed to resolve the symbols needed from client.so.");
+    if (!resolve_symbols("hw.so", hwso_addr, hwso_st, hwso_syms))
+        abort_with_err("Failed to resolve the symbols needed from hw.so.");
 
-    orig_Cbuf_InsertTextLines = (Cbuf_InsertTextLines_func_t)(hwso_addr + hwso_st.at("Cbuf_InsertTextLines"));
-    orig_PM_PlayerTrace = (PM_PlayerTrace_func_t)(hwso_addr + hwso_st.at("PM_PlayerTrace"));
-    orig_CL_CreateMove = (CL_CreateMove_func_t)(clso_addr + clso_st.at("CL_CreateMove"));
     orig_AddCommand = *(AddCommand_func_t *)(p_gEngfuncs + 0x44);
     orig_RegisterVariable = *(RegisterVariable_func_t *)(p_gEngfuncs + 0x38);
     orig_GetViewAngles = *(GetSetViewAngles_func_t *)(p_gEngfuncs + 0x88);
     orig_SetViewAngles = *(GetSetViewAngles_func_t *)(p_gEngfuncs + 0x8c);
     orig_Cmd_Argv = *(Cmd_Argv_func_t *)(p_gEngfuncs + 0x9c);
 
-    orig_IN_BackDown = (Keyin_func_t)(clso_addr + clso_st.at("_Z11IN_BackDownv"));
-    orig_IN_BackUp = (Keyin_func_t)(clso_addr + clso_st.at("_Z9IN_BackUpv"));
-    orig_IN_MoveleftDown = (Keyin_func_t)(clso_addr + clso_st.at("_Z15IN_MoveleftDownv"));
-    orig_IN_MoveleftUp = (Keyin_func_t)(clso_addr + clso_st.at("_Z13IN_MoveleftUpv"));
-    orig_IN_MoverightDown = (Keyin_func_t)(clso_addr + clso_st.at("_Z16IN_MoverightDownv"));
-    orig_IN_MoverightUp = (Keyin_func_t)(clso_addr + clso_st.at("_Z14IN_MoverightUpv"));
-    orig_IN_DuckDown = (Keyin_func_t)(clso_addr + clso_st.at("_Z11IN_DuckDownv"));
-    orig_IN_DuckUp = (Keyin_func_t)(clso_addr + clso_st.at("_Z9IN_DuckUpv"));
-    orig_IN_JumpDown = (Keyin_func_t)(clso_addr + clso_st.at("_Z11IN_JumpDownv"));
-    orig_IN_JumpUp = (Keyin_func_t)(clso_addr + clso_st.at("_Z9IN_JumpUpv"));
-
-    p_in_duck = (kbutton_t *)(clso_addr + clso_st.at("in_duck"));
-    p_in_jump = (kbutton_t *)(clso_addr + clso_st.at("in_jump"));
-    p_in_forward = (kbutton_t *)(clso_addr + clso_st.at("in_forward"));
-    p_in_back = (kbutton_t *)(clso_addr + clso_st.at("in_back"));
-    p_in_moveright = (kbutton_t *)(clso_addr + clso_st.at("in_moveright"));
-    p_in_moveleft = (kbutton_t *)(clso_addr + clso_st.at("in_moveleft"));
-    p_in_up = (kbutton_t *)(clso_addr + clso_st.at("in_up"));
-    p_in_down = (kbutton_t *)(clso_addr + clso_st.at("in_down"));
-    pp_cl_forwardspeed = (cvar_t **)(clso_addr + clso_st.at("cl_forwardspeed"));
-    pp_cl_sidespeed = (cvar_t **)(clso_addr + clso_st.at("cl_sidespeed"));
-    pp_cl_backspeed = (cvar_t **)(clso_addr + clso_st.at("cl_backspeed"));
-    pp_cl_upspeed = (cvar_t **)(clso_addr + clso_st.at("cl_upspeed"));
-
     cl_db4c_ceil = orig_RegisterVariable("cl_db4c_ceil", "0", 0);
     cl_lgagst_origM = orig_RegisterVariable("cl_lgagst_origM", "0", 0);
     cl_mtype = orig_RegisterVariable("cl_mtype", "1", 0);
+    cl_tas_lookahead = orig_RegisterVariable("cl_tas_lookahead", "1", 0);
 
     orig_AddCommand("+linestrafe", IN_LinestrafeDown);
     orig_AddCommand("-linestrafe", IN_LinestrafeUp);
@@ -981,4 +1131,5 @@ void initialize_movement(uintptr_t clso_addr, const symtbl_t &clso_st,
     orig_AddCommand("tas_lgagst", IN_TasLGAGST);
     orig_AddCommand("tas_sba", IN_TasStrafeByAng);
     orig_AddCommand("tas_s2y", IN_TasStrafeToYaw);
+    orig_AddCommand("tas_tracestats", IN_TasTraceStats);
 }
@@ -6,4 +6,7 @@
 void initialize_movement(uintptr_t clso_addr, const symtbl_t &clso_st,
                          uintptr_t hwso_addr, const symtbl_t &hwso_st);
 
+// Tell the predictor the msec of the usercmd the server has just run.
+void sync_movement_msec(int msec);
+
 #endif
@@ -1,6 +1,13 @@
 #include <cmath>
 #include "strafemath.hpp"
 
+#if defined(__AVX2__) && defined(__x86_64__) && defined(__GLIBC__)
+#include <immintrin.h>
+#if __GLIBC_PREREQ(2, 35)
+#define STRAFEMATH_AVX2_HYPOT
+#endif
+#endif
+
 double anglemod_deg(double a)
 {
     return M_U_DEG * ((int)(a / M_U_DEG) & 0xffff);
@@ -57,9 +64,9 @@ void strafe_fme_vec(double vel[2], const double avec[2], double L,
     vel[1] += avec[1] * tmp;
 }
 
-void strafe_fric(double vel[2], double E, double ktau)
+static inline void strafe_fric_speed(double vel[2], double speed, double E,
+                                     double ktau)
 {
-    double speed = std::hypot(vel[0], vel[1]);
     if (speed >= E) {
         vel[0] *= 1 - ktau;
         vel[1] *= 1 - ktau;
@@ -78,6 +85,11 @@ void strafe_fric(double vel[2], double E, double ktau)
     vel[1] = 0;
 }
 
+void strafe_fric(double vel[2], double E, double ktau)
+{
+    strafe_fric_speed(vel, std::hypot(vel[0], vel[1]), E, ktau);
+}
+
 double strafe_fric_spd(double spd, double E, double ktau)
 {
     if (spd >= E)
@@ -210,3 +222,125 @@ double strafe_opt_spd(double spd, double L, double tauMA)
         return std::sqrt(spd * spd + tauMA * (L + tmp));
     return spd + tauMA;
 }
+
+// With -ffast-math glibc lets loops calling hypot be vectorised with its
+// libmvec version, which does not round the same as the scalar one.  Calling
+// through here keeps them scalar.
+__attribute__((noinline))
+static double libm_hypot(double x, double y)
+{
+    return std::hypot(x, y);
+}
+
+#ifdef STRAFEMATH_AVX2_HYPOT
+// Four lanes of the hypot in glibc 2.35 and later, which the scalar code gets
+// from libm.  Fusing or reordering anything here would break the match, hence
+// the optimize attribute.  Lanes which glibc would rescale are left to libm.
+static const double HYPOT_EPS = 5.551115123125783e-17;       // 2^-54
+static const double HYPOT_LARGE = 6.703903964971299e+153;    // 2^511
+static const double HYPOT_TINY = 1.4916681462400413e-154;    // 2^-511
+
+__attribute__((optimize("no-fast-math", "fp-contract=off")))
+static void hypot4(const double *x, const double *y, double *out)
+{
+    const __m256d absmask = _mm256_castsi256_pd(
+        _mm256_set1_epi64x(0x7fffffffffffffffLL));
+    __m256d fx = _mm256_and_pd(_mm256_loadu_pd(x), absmask);
+    __m256d fy = _mm256_and_pd(_mm256_loadu_pd(y), absmask);
+    __m256d ax = _mm256_max_pd(fx, fy);
+    __m256d ay = _mm256_min_pd(fx, fy);
+
+    __m256d eps = _mm256_mul_pd(ax, _mm256_set1_pd(HYPOT_EPS));
+    __m256d small = _mm256_cmp_pd(ay, eps, _CMP_LE_OQ);
+    __m256d scaled = _mm256_or_pd(
+        _mm256_cmp_pd(ax, _mm256_set1_pd(HYPOT_LARGE), _CMP_NLE_UQ),
+        _mm256_cmp_pd(ay, _mm256_set1_pd(HYPOT_TINY), _CMP_LT_OQ));
+    if (_mm256_movemask_pd(_mm256_andnot_pd(small, scaled))) {
+        for (int i = 0; i < 4; i++)
+            out[i] = libm_hypot(x[i], y[i]);
+        return;
+    }
+
+    const __m256d two = _mm256_set1_pd(2.0);
+    __m256d h = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(ax, ax),
+                                             _mm256_mul_pd(ay, ay)));
+
+    __m256d delta = _mm256_sub_pd(h, ay);
+    __m256d t1a = _mm256_mul_pd(ax, _mm256_sub_pd(_mm256_mul_pd(two, delta),
+                                                  ax));
+    __m256d t2a = _mm256_mul_pd(
+        _mm256_sub_pd(delta, _mm256_mul_pd(two, _mm256_sub_pd(ax, ay))),
+        delta);
+
+    delta = _mm256_sub_pd(h, ax);
+    __m256d t1b = _mm256_mul_pd(_mm256_mul_pd(two, delta),
+                                _mm256_sub_pd(ax, _mm256_mul_pd(two, ay)));
+    __m256d t2b = _mm256_add_pd(
+        _mm256_mul_pd(_mm256_sub_pd(_mm256_mul_pd(_mm256_set1_pd(4.0), delta),
+                                    ay), ay),
+        _mm256_mul_pd(delta, delta));
+
+    __m256d nearaxis = _mm256_cmp_pd(h, _mm256_mul_pd(two, ay), _CMP_LE_OQ);
+    __m256d t = _mm256_add_pd(_mm256_blendv_pd(t1b, t1a, nearaxis),
+                              _mm256_blendv_pd(t2b, t2a, nearaxis));
+    h = _mm256_sub_pd(h, _mm256_div_pd(t, _mm256_mul_pd(two, h)));
+    h = _mm256_blendv_pd(h, _mm256_add_pd(ax, ay), small);
+    _mm256_storeu_pd(out, h);
+}
+#endif
+
+// The loops below call the scalar functions, which are inlined and
+// vectorised with the same operations as the scalar code, so the lanes agree
+// with it exactly.
+
+void strafe_fme_vec_batch(size_t n, double *velx, double *vely,
+                          const double *avecx, const double *avecy,
+                          const double *L, const double *tauMA)
+{
+    for (size_t i = 0; i < n; i++) {
+        double vel[2] = {velx[i], vely[i]};
+        double avec[2] = {avecx[i], avecy[i]};
+        strafe_fme_vec(vel, avec, L[i], tauMA[i]);
+        velx[i] = vel[0];
+        vely[i] = vel[1];
+    }
+}
+
+void strafe_fric_batch(size_t n, double *velx, double *vely, const double *E,
+                       const double *ktau)
+{
+    const size_t BLOCK = 256;
+    double speed[BLOCK];
+
+    for (size_t base = 0; base < n; base += BLOCK) {
+        size_t len = n - base < BLOCK ? n - base : BLOCK;
+        size_t i = 0;
+#ifdef STRAFEMATH_AVX2_HYPOT
+        for (; i + 4 <= len; i += 4)
+            hypot4(velx + base + i, vely + base + i, speed + i);
+#endif
+        for (; i < len; i++)
+            speed[i] = libm_hypot(velx[base + i], vely[base + i]);
+
+        for (i = 0; i < len; i++) {
+            double vel[2] = {velx[base + i], vely[base + i]};
+            strafe_fric_speed(vel, speed[i], E[base + i], ktau[base + i]);
+            velx[base + i] = vel[0];
+            vely[base + i] = vel[1];
+        }
+    }
+}
+
+void strafe_fric_spd_batch(size_t n, const double *spd, const double *E,
+                           const double *ktau, double *out)
+{
+    for (size_t i = 0; i < n; i++)
+        out[i] = strafe_fric_spd(spd[i], E[i], ktau[i]);
+}
+
+void strafe_opt_spd_batch(size_t n, const double *spd, const double *L,
+                          const double *tauMA, double *out)
+{
+    for (size_t i = 0; i < n; i++)
+        out[i] = strafe_opt_spd(spd[i], L[i], tauMA[i]);
+}
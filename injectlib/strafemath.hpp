@@ -1,6 +1,8 @@
 #ifndef STRAFEMATH_H
 #define STRAFEMATH_H
 
+#include <cstddef>
+
 const double M_U_DEG = 360.0 / 65536;
 const double M_U_RAD = M_PI / 32768;
 
@@ -26,6 +28,23 @@ double strafe_fric_spd(double spd, double E, double ktau);
 
 double strafe_opt_spd(double spd, double L, double tauMA);
 
+// Batched versions of the above over n lanes stored as separate arrays, for
+// offline searches which evaluate many states at once.  Velocities are updated
+// in place and speeds written to out.  Every lane gives bit for bit the same
+// result as the scalar function, and the arrays must not overlap.
+void strafe_fme_vec_batch(size_t n, double *velx, double *vely,
+                          const double *avecx, const double *avecy,
+                          const double *L, const double *tauMA);
+
+void strafe_fric_batch(size_t n, double *velx, double *vely, const double *E,
+                       const double *ktau);
+
+void strafe_fric_spd_batch(size_t n, const double *spd, const double *E,
+                           const double *ktau, double *out);
+
+void strafe_opt_spd_batch(size_t n, const double *spd, const double *L,
+                          const double *tauMA, double *out);
+
 double anglemod_deg(double a);
 double anglemod_rad(double a);
 
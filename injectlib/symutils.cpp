@@ -1,6 +1,12 @@
 #include <cstdio>
 #include <cstring>
+#include <stdexcept>
+#include <utility>
 #include <link.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "symutils.hpp"
 
 struct libbasearg_t
@@ -29,44 +35,276 @@ void get_loaded_lib_info(const char *libname, uintptr_t &addr,
     fullpath = arg.fullpath;
 }
 
-static long get_file_size(std::FILE *file)
+bool resolve_symbols(const char *libname, uintptr_t base, const symtbl_t &st,
+                     const symreq_t *reqs, size_t num_reqs)
 {
-    long orig_pos = std::ftell(file);
-    std::fseek(file, 0, SEEK_END);
-    long filesize = std::ftell(file);
-    std::fseek(file, orig_pos, SEEK_SET);
-    return filesize;
+    size_t num_found = 0;
+    bool ok = true;
+    for (size_t i = 0; i < num_reqs; i++) {
+        Elf32_Addr value = st[reqs[i].name];
+        if (value) {
+            *(uintptr_t *)reqs[i].target = base + value;
+            num_found++;
+            continue;
+        }
+        std::fprintf(stderr, "TAS: %s: missing %s symbol %s\n", libname,
+                     reqs[i].required ? "required" : "optional", reqs[i].name);
+        if (reqs[i].required)
+            ok = false;
+    }
+    std::fprintf(stderr, "TAS: %s: resolved %zu of %zu symbols\n", libname,
+                 num_found, num_reqs);
+    return ok;
+}
+
+static uint32_t gnu_hash_name(const char *name)
+{
+    uint32_t h = 5381;
+    for (; *name; name++)
+        h = (h << 5) + h + (unsigned char)*name;
+    return h;
+}
+
+static uint32_t sysv_hash_name(const char *name)
+{
+    uint32_t h = 0;
+    for (; *name; name++) {
+        h = (h << 4) + (unsigned char)*name;
+        uint32_t g = h & 0xf0000000;
+        if (g)
+            h ^= g >> 24;
+        h &= ~g;
+    }
+    return h;
+}
+
+symtbl_t::symtbl_t()
+    : filedat(nullptr), filesize(0), symtab(nullptr), st_num_entries(0),
+      strtab(nullptr), strtab_size(0), gnu_hash(nullptr), sysv_hash(nullptr)
+{
+}
+
+symtbl_t::symtbl_t(symtbl_t &&other)
+    : symtbl_t()
+{
+    *this = std::move(other);
+}
+
+symtbl_t &symtbl_t::operator=(symtbl_t &&other)
+{
+    if (this == &other)
+        return *this;
+    unmap();
+    filedat = other.filedat;
+    filesize = other.filesize;
+    symtab = other.symtab;
+    st_num_entries = other.st_num_entries;
+    strtab = other.strtab;
+    strtab_size = other.strtab_size;
+    gnu_hash = other.gnu_hash;
+    sysv_hash = other.sysv_hash;
+    other.filedat = nullptr;
+    other.unmap();
+    return *this;
+}
+
+symtbl_t::~symtbl_t()
+{
+    unmap();
+}
+
+void symtbl_t::unmap()
+{
+    if (filedat)
+        munmap((void *)filedat, filesize);
+    filedat = nullptr;
+    filesize = 0;
+    symtab = nullptr;
+    st_num_entries = 0;
+    strtab = nullptr;
+    strtab_size = 0;
+    gnu_hash = nullptr;
+    sysv_hash = nullptr;
+}
+
+Elf32_Addr symtbl_t::at(const char *name) const
+{
+    Elf32_Addr value;
+    if (!find(name, value))
+        throw std::out_of_range(std::string("symbol not found: ") + name);
+    return value;
+}
+
+Elf32_Addr symtbl_t::operator[](const char *name) const
+{
+    Elf32_Addr value;
+    return find(name, value) ? value : 0;
+}
+
+bool symtbl_t::find(const char *name, Elf32_Addr &value) const
+{
+    if (gnu_hash)
+        return find_gnu(name, value);
+    if (sysv_hash)
+        return find_sysv(name, value);
+    return false;
+}
+
+bool symtbl_t::match(uint32_t symidx, const char *name,
+                     Elf32_Addr &value) const
+{
+    if (symidx >= st_num_entries)
+        return false;
+    const Elf32_Sym &sym = symtab[symidx];
+    if (sym.st_shndx == SHN_UNDEF || sym.st_name >= strtab_size)
+        return false;
+    const char *symname = strtab + sym.st_name;
+    size_t maxlen = strtab_size - sym.st_name;
+    if (strnlen(symname, maxlen) == maxlen || std::strcmp(symname, name) != 0)
+        return false;
+    value = sym.st_value;
+    return true;
+}
+
+bool symtbl_t::find_gnu(const char *name, Elf32_Addr &value) const
+{
+    uint32_t nbuckets = gnu_hash[0];
+    uint32_t symoffset = gnu_hash[1];
+    uint32_t bloom_size = gnu_hash[2];
+    uint32_t bloom_shift = gnu_hash[3];
+    const uint32_t *bloom = gnu_hash + 4;
+    const uint32_t *buckets = bloom + bloom_size;
+    const uint32_t *chain = buckets + nbuckets;
+
+    uint32_t h = gnu_hash_name(name);
+    uint32_t word = bloom[(h / 32) % bloom_size];
+    uint32_t mask = (1u << (h % 32)) | (1u << ((h >> bloom_shift) % 32));
+    if ((word & mask) != mask)
+        return false;
+
+    uint32_t symidx = buckets[h % nbuckets];
+    if (symidx < symoffset)
+        return false;
+    for (; symidx < st_num_entries; symidx++) {
+        uint32_t h2 = chain[symidx - symoffset];
+        if ((h | 1) == (h2 | 1) && match(symidx, name, value))
+            return true;
+        if (h2 & 1)
+            break;
+    }
+    return false;
+}
+
+bool symtbl_t::find_sysv(const char *name, Elf32_Addr &value) const
+{
+    uint32_t nbuckets = sysv_hash[0];
+    uint32_t nchain = sysv_hash[1];
+    const uint32_t *buckets = sysv_hash + 2;
+    const uint32_t *chain = buckets + nbuckets;
+
+    // The chain can be no longer than the symbol table, so bound the walk
+    // in case the table is corrupt.
+    uint32_t symidx = buckets[sysv_hash_name(name) % nbuckets];
+    for (uint32_t n = 0; symidx != STN_UNDEF && symidx < nchain &&
+             n < nchain; symidx = chain[symidx], n++)
+        if (match(symidx, name, value))
+            return true;
+    return false;
+}
+
+// Returns the section of the given type linked to the section link, or
+// nullptr.
+static const Elf32_Shdr *find_section(const Elf32_Shdr *sh_hdr, int sh_num,
+                                      uint32_t type, uint32_t link)
+{
+    for (int i = 0; i < sh_num; i++)
+        if (sh_hdr[i].sh_type == type && sh_hdr[i].sh_link == link)
+            return &sh_hdr[i];
+    return nullptr;
 }
 
 symtbl_t get_symbols(const char *libpath)
 {
-    symtbl_t sym_straddr_tbl;
-    std::FILE *libfile = std::fopen(libpath, "r");
-    if (!libfile)
-        return sym_straddr_tbl;
-    long filesize = get_file_size(libfile);
-    char *filedat = new char[filesize];
-    std::fread(filedat, 1, filesize, libfile);
-    std::fclose(libfile);
-
-    Elf32_Ehdr *elf_hdr = (Elf32_Ehdr *)filedat;
-    Elf32_Shdr *sh_hdr = (Elf32_Shdr *)(filedat + elf_hdr->e_shoff);
-    Elf32_Shdr *sh_shstrhdr = sh_hdr + elf_hdr->e_shstrndx;
-    char *sh_shstrtab = filedat + sh_shstrhdr->sh_offset;
-
-    int i;
-    for (i = 0; sh_hdr[i].sh_type != SHT_DYNSYM; i++);
-    Elf32_Sym *symtab = (Elf32_Sym *)(filedat + sh_hdr[i].sh_offset);
-    uint64_t st_num_entries = sh_hdr[i].sh_size / sizeof(Elf32_Sym);
-
-    for (i = 0; sh_hdr[i].sh_type != SHT_STRTAB ||
-             strcmp(sh_shstrtab + sh_hdr[i].sh_name, ".dynstr") != 0; i++);
-    char *sh_strtab = filedat + sh_hdr[i].sh_offset;
-
-    for (uint64_t i = 0; i < st_num_entries; i++)
-        sym_straddr_tbl[std::string(sh_strtab + symtab[i].st_name)] =
-            symtab[i].st_value;
-
-    delete[] filedat;
-    return sym_straddr_tbl;
+    symtbl_t symtbl;
+    int fd = open(libpath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return symtbl;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(Elf32_Ehdr)) {
+        close(fd);
+        return symtbl;
+    }
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return symtbl;
+    symtbl.filedat = (const char *)map;
+    symtbl.filesize = st.st_size;
+
+    const char *filedat = symtbl.filedat;
+    size_t filesize = symtbl.filesize;
+    const Elf32_Ehdr *elf_hdr = (const Elf32_Ehdr *)filedat;
+    if (std::memcmp(elf_hdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+        elf_hdr->e_ident[EI_CLASS] != ELFCLASS32 ||
+        elf_hdr->e_shentsize != sizeof(Elf32_Shdr) ||
+        elf_hdr->e_shoff > filesize ||
+        elf_hdr->e_shnum > (filesize - elf_hdr->e_shoff) / sizeof(Elf32_Shdr)) {
+        symtbl.unmap();
+        return symtbl;
+    }
+
+    const Elf32_Shdr *sh_hdr = (const Elf32_Shdr *)(filedat + elf_hdr->e_shoff);
+    int sh_num = elf_hdr->e_shnum;
+    int dynsym_idx;
+    for (dynsym_idx = 0; dynsym_idx < sh_num &&
+             sh_hdr[dynsym_idx].sh_type != SHT_DYNSYM; dynsym_idx++);
+    if (dynsym_idx == sh_num || sh_hdr[dynsym_idx].sh_link >= (uint32_t)sh_num) {
+        symtbl.unmap();
+        return symtbl;
+    }
+
+    const Elf32_Shdr *sh_dynsym = &sh_hdr[dynsym_idx];
+    const Elf32_Shdr *sh_dynstr = &sh_hdr[sh_dynsym->sh_link];
+    const Elf32_Shdr *sh_hash = find_section(sh_hdr, sh_num, SHT_GNU_HASH,
+                                             dynsym_idx);
+    bool is_gnu = sh_hash;
+    if (!sh_hash)
+        sh_hash = find_section(sh_hdr, sh_num, SHT_HASH, dynsym_idx);
+    const Elf32_Shdr *sections[] = {sh_dynsym, sh_dynstr, sh_hash};
+    for (const Elf32_Shdr *sect : sections) {
+        if (!sect || sect->sh_offset > filesize ||
+            sect->sh_size > filesize - sect->sh_offset ||
+            sect->sh_offset % 4) {
+            symtbl.unmap();
+            return symtbl;
+        }
+    }
+
+    // Make sure every table the lookups index into lies within the section.
+    const uint32_t *hash = (const uint32_t *)(filedat + sh_hash->sh_offset);
+    size_t hash_words = sh_hash->sh_size / 4;
+    uint32_t st_num_entries = sh_dynsym->sh_size / sizeof(Elf32_Sym);
+    bool hash_ok;
+    if (is_gnu)
+        hash_ok = hash_words >= 4 && hash[0] && hash[2] &&
+            hash[1] <= st_num_entries &&
+            (size_t)hash[2] + hash[0] + (st_num_entries - hash[1]) <=
+            hash_words - 4;
+    else
+        hash_ok = hash_words >= 2 && hash[0] &&
+            (size_t)hash[0] + hash[1] <= hash_words - 2;
+    if (!hash_ok) {
+        symtbl.unmap();
+        return symtbl;
+    }
+
+    symtbl.symtab = (const Elf32_Sym *)(filedat + sh_dynsym->sh_offset);
+    symtbl.st_num_entries = st_num_entries;
+    symtbl.strtab = filedat + sh_dynstr->sh_offset;
+    symtbl.strtab_size = sh_dynstr->sh_size;
+    if (is_gnu)
+        symtbl.gnu_hash = hash;
+    else
+        symtbl.sysv_hash = hash;
+    return symtbl;
 }
@@ -1,11 +1,73 @@
 #ifndef SYMUTILS_H
 #define SYMUTILS_H
 
-#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <elf.h>
 
-typedef std::unordered_map<std::string, Elf32_Addr> symtbl_t;
+// Dynamic symbols of a library, looked up through the library's own
+// .gnu.hash or .hash table in a read only mapping of the file, so only the
+// pages holding the names asked for are ever read.  Only defined symbols are
+// found.
+class symtbl_t
+{
+public:
+    symtbl_t();
+    symtbl_t(symtbl_t &&other);
+    symtbl_t &operator=(symtbl_t &&other);
+    ~symtbl_t();
+
+    // Returns the value of the symbol, or throws std::out_of_range.
+    Elf32_Addr at(const char *name) const;
+    // Returns the value of the symbol, or 0 if it is not found.
+    Elf32_Addr operator[](const char *name) const;
+
+private:
+    friend symtbl_t get_symbols(const char *libpath);
+
+    symtbl_t(const symtbl_t &) = delete;
+    symtbl_t &operator=(const symtbl_t &) = delete;
+
+    bool find(const char *name, Elf32_Addr &value) const;
+    bool find_gnu(const char *name, Elf32_Addr &value) const;
+    bool find_sysv(const char *name, Elf32_Addr &value) const;
+    bool match(uint32_t symidx, const char *name, Elf32_Addr &value) const;
+    void unmap();
+
+    const char *filedat;
+    size_t filesize;
+    const Elf32_Sym *symtab;
+    uint32_t st_num_entries;
+    const char *strtab;
+    size_t strtab_size;
+    const uint32_t *gnu_hash;
+    const uint32_t *sysv_hash;
+};
+
+// A symbol wanted from a library.  target points at the variable which
+// receives the symbol's address in the loaded library, whatever the pointer
+// type of that variable.  A missing optional symbol leaves target untouched.
+struct symreq_t
+{
+    const char *name;
+    void *target;
+    bool required;
+};
+
+// Resolves every request against the library loaded at base in one pass and
+// prints a summary line on stderr, naming each missing symbol.  Returns false
+// if any required symbol is missing.
+bool resolve_symbols(const char *libname, uintptr_t base, const symtbl_t &st,
+                     const symreq_t *reqs, size_t num_reqs);
+
+template<size_t N>
+inline bool resolve_symbols(const char *libname, uintptr_t base,
+                            const symtbl_t &st, const symreq_t (&reqs)[N])
+{
+    return resolve_symbols(libname, base, st, reqs, N);
+}
+
 void get_loaded_lib_info(const char *libname, uintptr_t &addr,
                          std::string &fullpath);
 symtbl_t get_symbols(const char *libpath);
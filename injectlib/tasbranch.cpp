@@ -0,0 +1,367 @@
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <dlfcn.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "common.hpp"
+#include "symutils.hpp"
+#include "tasbranch.hpp"
+
+#define SDL_NAME "libSDL2-2.0.so.0"
+
+typedef int (*SDL_PollEvent_func_t)(void *);
+typedef void (*SDL_void_func_t)();
+typedef void (*SDL_GL_SwapWindow_func_t)(void *);
+typedef void (*SDL_WarpMouseInWindow_func_t)(void *, int, int);
+typedef void (*SDL_AudioDevice_func_t)(uint32_t);
+
+static const int MAX_BRANCHES = 64;
+
+// What a child reports to the parent once it has run its frames.
+struct branch_result_t
+{
+    int frames;
+    float pos[3];
+    float vel[3];
+    float health;
+};
+
+enum branch_status_t
+{
+    BranchDone,
+    BranchDied,
+    BranchTimedOut,
+};
+
+cvar_t sv_tas_branch_timeout;
+
+// In a child, the write end of the pipe to the parent, or -1 otherwise.
+static int branch_pipe = -1;
+static int branch_frames = 0;
+static int branch_frames_run = 0;
+
+static std::once_flag sdl_once;
+static bool sdl_found = false;
+static SDL_PollEvent_func_t orig_SDL_PollEvent = nullptr;
+static SDL_void_func_t orig_SDL_PumpEvents = nullptr;
+static SDL_GL_SwapWindow_func_t orig_SDL_GL_SwapWindow = nullptr;
+static SDL_WarpMouseInWindow_func_t orig_SDL_WarpMouseInWindow = nullptr;
+static SDL_void_func_t orig_SDL_LockAudio = nullptr;
+static SDL_void_func_t orig_SDL_UnlockAudio = nullptr;
+static SDL_AudioDevice_func_t orig_SDL_LockAudioDevice = nullptr;
+static SDL_AudioDevice_func_t orig_SDL_UnlockAudioDevice = nullptr;
+
+// SDL is only looked up once it is first called, as it may be loaded after
+// this library.  Whatever is not found in SDL_NAME, which may be loaded
+// under another name, is left to the dynamic linker.  On OPFOR builds the
+// dlsym called here is our own hook, which passes it on unchanged.
+static void load_sdl_symbols()
+{
+    static const symreq_t syms[] = {
+        {"SDL_PollEvent", &orig_SDL_PollEvent, true},
+        {"SDL_PumpEvents", &orig_SDL_PumpEvents, true},
+        {"SDL_GL_SwapWindow", &orig_SDL_GL_SwapWindow, true},
+        {"SDL_WarpMouseInWindow", &orig_SDL_WarpMouseInWindow, true},
+        {"SDL_LockAudio", &orig_SDL_LockAudio, true},
+        {"SDL_UnlockAudio", &orig_SDL_UnlockAudio, true},
+        {"SDL_LockAudioDevice", &orig_SDL_LockAudioDevice, true},
+        {"SDL_UnlockAudioDevice", &orig_SDL_UnlockAudioDevice, true},
+    };
+
+    uintptr_t sdl_addr = 0;
+    std::string sdl_fullpath;
+    get_loaded_lib_info(SDL_NAME, sdl_addr, sdl_fullpath);
+    if (sdl_addr) {
+        symtbl_t sdl_st = get_symbols(sdl_fullpath.c_str());
+        resolve_symbols(SDL_NAME, sdl_addr, sdl_st, syms);
+    }
+
+    sdl_found = true;
+    for (const symreq_t &req : syms) {
+        uintptr_t *target = (uintptr_t *)req.target;
+        if (!*target)
+            *target = (uintptr_t)dlsym(RTLD_NEXT, req.name);
+        if (!*target)
+            sdl_found = false;
+    }
+}
+
+// The real SDL function, which the game must get outside a child.
+template<typename func_t>
+static func_t real_sdl(func_t &orig, const char *name)
+{
+    std::call_once(sdl_once, load_sdl_symbols);
+    if (!orig)
+        abort_with_err("Failed to resolve %s.", name);
+    return orig;
+}
+
+// A child shares the window, the input and the sound device with the parent,
+// so the SDL calls below which reach them are dropped there.  The audio
+// thread is not forked either, so nothing is left to take the audio lock
+// from.
+
+extern "C" int SDL_PollEvent(void *event)
+{
+    if (branch_pipe >= 0)
+        return 0;
+    return real_sdl(orig_SDL_PollEvent, "SDL_PollEvent")(event);
+}
+
+extern "C" void SDL_PumpEvents()
+{
+    if (branch_pipe < 0)
+        real_sdl(orig_SDL_PumpEvents, "SDL_PumpEvents")();
+}
+
+extern "C" void SDL_GL_SwapWindow(void *window)
+{
+    if (branch_pipe < 0)
+        real_sdl(orig_SDL_GL_SwapWindow, "SDL_GL_SwapWindow")(window);
+}
+
+extern "C" void SDL_WarpMouseInWindow(void *window, int x, int y)
+{
+    if (branch_pipe < 0)
+        real_sdl(orig_SDL_WarpMouseInWindow, "SDL_WarpMouseInWindow")(
+            window, x, y);
+}
+
+extern "C" void SDL_LockAudio()
+{
+    if (branch_pipe < 0)
+        real_sdl(orig_SDL_LockAudio, "SDL_LockAudio")();
+}
+
+extern "C" void SDL_UnlockAudio()
+{
+    if (branch_pipe < 0)
+        real_sdl(orig_SDL_UnlockAudio, "SDL_UnlockAudio")();
+}
+
+extern "C" void SDL_LockAudioDevice(uint32_t dev)
+{
+    if (branch_pipe < 0)
+        real_sdl(orig_SDL_LockAudioDevice, "SDL_LockAudioDevice")(dev);
+}
+
+extern "C" void SDL_UnlockAudioDevice(uint32_t dev)
+{
+    if (branch_pipe < 0)
+        real_sdl(orig_SDL_UnlockAudioDevice, "SDL_UnlockAudioDevice")(dev);
+}
+
+static bool write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = (const char *)buf;
+    while (len) {
+        ssize_t ret = write(fd, p, len);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0)
+            return false;
+        p += ret;
+        len -= ret;
+    }
+    return true;
+}
+
+static bool read_all(int fd, void *buf, size_t len)
+{
+    char *p = (char *)buf;
+    while (len) {
+        ssize_t ret = read(fd, p, len);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0)
+            return false;
+        p += ret;
+        len -= ret;
+    }
+    return true;
+}
+
+// Turn a freshly forked process into a child running script.  Logging is
+// turned off because the writer thread of sv_taslog 2 does not survive the
+// fork, and the parent's log is no place for a branch anyway.
+static void start_child(int fd, int frames)
+{
+    branch_pipe = fd;
+    branch_frames = frames;
+    branch_frames_run = 0;
+    orig_Cvar_SetValue("sv_taslog", 0);
+    orig_Cvar_SetValue("sv_tas_turbo", 1);
+}
+
+// Wait for a report from each of the num children until the timeout, then
+// kill whichever are left.  A report is a single write smaller than
+// PIPE_BUF, so it is all there once the pipe is readable.
+static void wait_children(int num, const int fds[], const pid_t pids[],
+                          branch_result_t results[], branch_status_t status[])
+{
+    auto deadline = std::chrono::steady_clock::now() +
+        std::chrono::milliseconds((long)(sv_tas_branch_timeout.value * 1000));
+    pollfd pfds[MAX_BRANCHES];
+    int waiting = num;
+    for (int i = 0; i < num; i++) {
+        pfds[i].fd = fds[i];
+        pfds[i].events = POLLIN;
+        status[i] = BranchTimedOut;
+    }
+
+    while (waiting) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now());
+        if (left.count() <= 0)
+            break;
+        int ret = poll(pfds, num, (int)left.count());
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0)
+            break;
+        for (int i = 0; i < num; i++) {
+            if (pfds[i].fd < 0 || !pfds[i].revents)
+                continue;
+            status[i] = read_all(fds[i], &results[i], sizeof(results[i])) ?
+                BranchDone : BranchDied;
+            pfds[i].fd = -1;
+            waiting--;
+        }
+    }
+
+    for (int i = 0; i < num; i++) {
+        if (status[i] == BranchTimedOut)
+            kill(pids[i], SIGKILL);
+        close(fds[i]);
+        while (waitpid(pids[i], nullptr, 0) < 0 && errno == EINTR)
+            ;
+    }
+}
+
+static void print_results(int num, const char *const scripts[],
+                          const branch_result_t results[],
+                          const branch_status_t status[], int frames)
+{
+    int best = -1;
+    for (int i = 0; i < num; i++) {
+        if (status[i] != BranchDone || results[i].frames < frames)
+            continue;
+        if (best < 0 || std::hypot(results[i].vel[0], results[i].vel[1]) >
+            std::hypot(results[best].vel[0], results[best].vel[1]))
+            best = i;
+    }
+
+    orig_Con_Printf("  %7s %11s %11s %11s %9s %9s %6s  %s\n", "frames", "x",
+                    "y", "z", "hspeed", "vspeed", "health", "script");
+    for (int i = 0; i < num; i++) {
+        const branch_result_t &res = results[i];
+        if (status[i] != BranchDone) {
+            orig_Con_Printf("  %7s %11s %11s %11s %9s %9s %6s  %s\n",
+                            status[i] == BranchDied ? "died" : "timeout",
+                            "-", "-", "-", "-", "-", "-", scripts[i]);
+            continue;
+        }
+        orig_Con_Printf("%c %7d %11.3f %11.3f %11.3f %9.3f %9.3f %6.0f  %s\n",
+                        i == best ? '*' : ' ', res.frames, res.pos[0],
+                        res.pos[1], res.pos[2],
+                        std::hypot(res.vel[0], res.vel[1]), res.vel[2],
+                        res.health, scripts[i]);
+    }
+}
+
+const char *tas_branch_cmd(int argc, const char *const argv[])
+{
+    if (argc < 3) {
+        orig_Con_Printf("Usage: tas_branch <frames> <script> [<script> ...]\n");
+        return nullptr;
+    }
+    if (branch_pipe >= 0) {
+        orig_Con_Printf("tas_branch cannot be used within a branch.\n");
+        return nullptr;
+    }
+    // Every SDL call a child drops must be known, or a child could reach
+    // the parent's window or an audio lock held at the fork.
+    std::call_once(sdl_once, load_sdl_symbols);
+    if (!sdl_found) {
+        orig_Con_Printf("tas_branch: not all of the SDL functions were "
+                        "found, so the branches could not be kept off the "
+                        "window and the sound device.\n");
+        return nullptr;
+    }
+    int frames = std::atoi(argv[1]);
+    if (frames <= 0) {
+        orig_Con_Printf("tas_branch: the number of frames must be positive.\n");
+        return nullptr;
+    }
+    int num = argc - 2;
+    if (num > MAX_BRANCHES) {
+        orig_Con_Printf("tas_branch: at most %d scripts can be tried.\n",
+                        MAX_BRANCHES);
+        return nullptr;
+    }
+    const char *const *scripts = argv + 2;
+
+    // Anything left in the stdio buffers would be written by every child.
+    std::fflush(nullptr);
+
+    int fds[MAX_BRANCHES];
+    pid_t pids[MAX_BRANCHES];
+    int started = 0;
+    for (; started < num; started++) {
+        int pipefd[2];
+        if (pipe(pipefd) < 0)
+            break;
+        pid_t pid = fork();
+        if (pid < 0) {
+            close(pipefd[0]);
+            close(pipefd[1]);
+            break;
+        }
+        if (pid == 0) {
+            close(pipefd[0]);
+            for (int i = 0; i < started; i++)
+                close(fds[i]);
+            start_child(pipefd[1], frames);
+            return scripts[started];
+        }
+        close(pipefd[1]);
+        fds[started] = pipefd[0];
+        pids[started] = pid;
+    }
+    if (started < num)
+        orig_Con_Printf("tas_branch: only %d of %d branches could be "
+                        "started.\n", started, num);
+
+    branch_result_t results[MAX_BRANCHES];
+    branch_status_t status[MAX_BRANCHES];
+    wait_children(started, fds, pids, results, status);
+    print_results(started, scripts, results, status, frames);
+    return nullptr;
+}
+
+void tas_branch_frame()
+{
+    if (branch_pipe < 0 || ++branch_frames_run < branch_frames)
+        return;
+
+    branch_result_t res = branch_result_t();
+    res.frames = branch_frames_run;
+    if (pp_sv_player && *pp_sv_player) {
+        uintptr_t entvars = *pp_sv_player + 0x80;
+        for (int i = 0; i < 3; i++) {
+            res.pos[i] = ((float *)(entvars + 0x8))[i];
+            res.vel[i] = ((float *)(entvars + 0x20))[i];
+        }
+        res.health = *(float *)(entvars + 0x160);
+    }
+    write_all(branch_pipe, &res, sizeof(res));
+    // Nothing of the game is to be torn down, as the parent still uses it.
+    _exit(0);
+}
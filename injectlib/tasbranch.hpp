@@ -0,0 +1,23 @@
+#ifndef TASBRANCH_H
+#define TASBRANCH_H
+
+#include "common.hpp"
+
+// Trying several continuations from the current frame at once.  tas_branch
+// forks the game once for each script given, and every child runs its script
+// in turbo mode for a number of host frames before reporting where the player
+// ended up to the parent over a pipe.  The parent waits for all of them, so
+// it is still at the frame branched from when the results are printed.
+// Children which have not reported within sv_tas_branch_timeout seconds are
+// killed.  In a child, the SDL calls for input, drawing and sound do nothing.
+
+extern cvar_t sv_tas_branch_timeout;
+
+// The tas_branch command, with argv as given by Cmd_Argv.  Returns the script
+// the caller is to exec in a child, or nullptr in the parent.
+const char *tas_branch_cmd(int argc, const char *const argv[]);
+
+// Called once every host frame.  Ends a child once it has run its frames.
+void tas_branch_frame();
+
+#endif
@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include "common.hpp"
+#include "taslog.hpp"
+#include "taslogcodec.hpp"
+
+// The ring is indexed by free running byte counters, so its size must be a
+// power of two for the modulo to survive the counters wrapping around.  The
+// engine thread only ever advances ring_head and the writer thread only ever
+// advances ring_tail, so neither needs a lock.
+static const size_t RING_SIZE = 1 << 20;
+static const size_t WAKE_THRESHOLD = RING_SIZE / 4;
+
+static char ring[RING_SIZE];
+static std::atomic<size_t> ring_head(0);    // bytes queued by the engine
+static std::atomic<size_t> ring_tail(0);    // bytes written out
+static std::atomic<bool> writer_quit(false);
+static std::mutex writer_mutex;
+static std::condition_variable writer_cv;
+static std::thread writer_thread;
+static int log_fd = -1;
+static bool open_failed = false;
+static unsigned int num_dropped = 0;
+
+// Only used by the writer thread.
+static taslog_codec_t codec;
+static char out_buf[1 << 16];
+
+static void write_all(const char *buf, size_t len)
+{
+    while (len) {
+        ssize_t ret = write(log_fd, buf, len);
+        if (ret < 0)
+            return;
+        buf += ret;
+        len -= ret;
+    }
+}
+
+static void copy_from_ring(size_t pos, void *dst, size_t len)
+{
+    size_t start = pos % RING_SIZE;
+    size_t first = std::min(len, RING_SIZE - start);
+    std::memcpy(dst, ring + start, first);
+    std::memcpy((char *)dst + first, ring, len - first);
+}
+
+// Encode the records in [tail, head) of the ring and write them out in
+// batches, giving each batch's space in the ring back as soon as it is
+// written.  The engine thread only publishes whole records, so the range
+// never ends in the middle of one.
+static void write_records(size_t tail, size_t head)
+{
+    size_t out_len = 0;
+    while (tail != head) {
+        taslog_rechdr_t hdr;
+        copy_from_ring(tail, &hdr, sizeof(hdr));
+        char rec[TASLOG_MAX_RECSIZE];
+        copy_from_ring(tail, rec, std::min((size_t)hdr.size, sizeof(rec)));
+        out_len += codec.encode(rec, out_buf + out_len);
+        tail += hdr.size;
+
+        if (out_len > sizeof(out_buf) - TASLOG_MAX_ENCODED || tail == head) {
+            write_all(out_buf, out_len);
+            out_len = 0;
+            ring_tail.store(tail, std::memory_order_release);
+        }
+    }
+}
+
+static void writer_main()
+{
+    for (;;) {
+        // The engine thread does not take the mutex before notifying, so a
+        // wakeup can be missed.  The timeout bounds how long that delays us.
+        {
+            std::unique_lock<std::mutex> lock(writer_mutex);
+            writer_cv.wait_for(lock, std::chrono::milliseconds(100), [] {
+                return ring_head.load(std::memory_order_relaxed) -
+                    ring_tail.load(std::memory_order_relaxed) >=
+                    WAKE_THRESHOLD || writer_quit;
+            });
+        }
+
+        size_t tail = ring_tail.load(std::memory_order_relaxed);
+        size_t head = ring_head.load(std::memory_order_acquire);
+        if (head == tail) {
+            if (writer_quit)
+                break;
+            continue;
+        }
+        write_records(tail, head);
+    }
+}
+
+static void close_log()
+{
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex);
+        writer_quit = true;
+    }
+    writer_cv.notify_all();
+    writer_thread.join();
+    close(log_fd);
+    log_fd = -1;
+}
+
+static bool open_log()
+{
+    if (open_failed)
+        return false;
+
+    // qconsole.log lives in the parent of com_gamedir, so put ours there too.
+    std::string path = gamedir;
+    size_t slash = path.find_last_of('/');
+    path.erase(slash == std::string::npos ? 0 : slash + 1);
+    path += "qconsole.taslog";
+
+    log_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (log_fd == -1) {
+        open_failed = true;
+        orig_Con_Printf("Failed to open %s for writing.\n", path.c_str());
+        return false;
+    }
+
+    taslog_filehdr_t hdr;
+    std::memcpy(hdr.magic, TASLOG_MAGIC, sizeof(hdr.magic));
+    hdr.version = TASLOG_VERSION;
+    hdr.hdrsize = sizeof(hdr);
+    write_all((const char *)&hdr, sizeof(hdr));
+
+    writer_thread = std::thread(writer_main);
+    std::atexit(close_log);
+    return true;
+}
+
+void taslog_write(const void *rec, size_t size)
+{
+    if (log_fd == -1 && !open_log())
+        return;
+
+    // Never wait for the writer.  If it has fallen so far behind that the
+    // ring is full, losing a record is better than stalling the game.
+    size_t head = ring_head.load(std::memory_order_relaxed);
+    size_t tail = ring_tail.load(std::memory_order_acquire);
+    if (RING_SIZE - (head - tail) < size) {
+        num_dropped++;
+        orig_Cvar_SetValue("sv_taslog_dropped", num_dropped);
+        writer_cv.notify_one();
+        return;
+    }
+
+    size_t start = head % RING_SIZE;
+    size_t first = std::min(size, RING_SIZE - start);
+    std::memcpy(ring + start, rec, first);
+    std::memcpy(ring, (const char *)rec + first, size - first);
+    ring_head.store(head + size, std::memory_order_release);
+
+    // Only wake the writer when crossing the threshold, rather than on
+    // every record past it.
+    if (head - tail < WAKE_THRESHOLD && head + size - tail >= WAKE_THRESHOLD)
+        writer_cv.notify_one();
+}
@@ -0,0 +1,141 @@
+#ifndef TASLOG_H
+#define TASLOG_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Binary TAS log written when sv_taslog is 2.  The file starts with a
+// taslog_filehdr_t followed by a stream of records, each beginning with a
+// taslog_rechdr_t.  Every record type has a fixed layout made of 32-bit
+// fields only.  Version 1 files held the structs below as they are; since
+// version 2 they are compacted as described in taslogcodec.hpp.  Bump
+// TASLOG_VERSION whenever any of them or their encoding changes.
+
+const char TASLOG_MAGIC[8] = {'H', 'L', 'T', 'A', 'S', 'L', 'O', 'G'};
+const uint32_t TASLOG_VERSION = 2;
+
+enum taslog_rectype_t
+{
+    RecPrethink = 1,
+    RecPmovePre,
+    RecPmovePost,
+    RecDamage,
+    RecYawspeed,
+};
+
+// Bits of sv_taslog_channels, one for each kind of line printed by
+// sv_taslog 1.  A record is written if any of the lines it holds is enabled.
+enum taslog_channel_t
+{
+    ChanPrethink = 1 << 0,
+    ChanHealth = 1 << 1,
+    ChanUsercmd = 1 << 2,
+    ChanFsu = 1 << 3,
+    ChanFg = 1 << 4,
+    ChanPa = 1 << 5,
+    ChanPos = 1 << 6,
+    ChanPmove = 1 << 7,
+    ChanNtl = 1 << 8,
+    ChanDamage = 1 << 9,
+    ChanYawspeed = 1 << 10,
+};
+
+const unsigned int TASLOG_PRETHINK_CHANNELS = ChanPrethink | ChanHealth;
+const unsigned int TASLOG_PMOVE_PRE_CHANNELS = ChanUsercmd | ChanFsu |
+    ChanFg | ChanPa | ChanPos | ChanPmove;
+const unsigned int TASLOG_PMOVE_POST_CHANNELS = ChanNtl | ChanPos | ChanPmove;
+
+struct taslog_filehdr_t
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t hdrsize;
+};
+
+struct taslog_rechdr_t
+{
+    uint16_t type;
+    uint16_t size;
+};
+
+// prethink and health lines
+struct taslog_prethink_t
+{
+    taslog_rechdr_t hdr;
+    uint32_t frameno;
+    float frametime;
+    float health;
+    float armor;
+};
+
+// usercmd, fsu, fg, pa, pos 1 and pmove 1 lines
+struct taslog_pmove_pre_t
+{
+    taslog_rechdr_t hdr;
+    uint32_t msec;
+    uint32_t buttons;
+    float pitch;
+    float yaw;
+    float fsu[3];
+    float friction;
+    float gravity;
+    float punchangle[2];
+    float pos[3];
+    float vel[3];
+    float basevel[3];
+    int32_t induck;
+    uint32_t flags;
+    int32_t onground;
+    int32_t waterlevel;
+};
+
+// ntl, pos 2 and pmove 2 lines
+struct taslog_pmove_post_t
+{
+    taslog_rechdr_t hdr;
+    int32_t numtouch;
+    int32_t ladder;
+    float pos[3];
+    float vel[3];
+    float basevel[3];
+    int32_t induck;
+    uint32_t flags;
+    int32_t onground;
+    int32_t waterlevel;
+};
+
+struct taslog_damage_t
+{
+    taslog_rechdr_t hdr;
+    float damage;
+    int32_t bits;
+};
+
+struct taslog_yawspeed_t
+{
+    taslog_rechdr_t hdr;
+    float yawspeed;
+};
+
+static_assert(sizeof(taslog_filehdr_t) == 16, "taslog_filehdr_t is padded");
+static_assert(sizeof(taslog_prethink_t) == 20, "taslog_prethink_t is padded");
+static_assert(sizeof(taslog_pmove_pre_t) == 100, "taslog_pmove_pre_t is padded");
+static_assert(sizeof(taslog_pmove_post_t) == 64, "taslog_pmove_post_t is padded");
+static_assert(sizeof(taslog_damage_t) == 12, "taslog_damage_t is padded");
+static_assert(sizeof(taslog_yawspeed_t) == 8, "taslog_yawspeed_t is padded");
+
+// Queue a record to be written to qconsole.taslog by the writer thread.  The
+// file is created on the first call.  Only the engine thread may call this.
+// It never blocks; if the queue is full the record is dropped and counted in
+// sv_taslog_dropped.
+void taslog_write(const void *rec, size_t size);
+
+template<typename T>
+inline void taslog_write(T &rec, taslog_rectype_t type)
+{
+    rec.hdr.type = type;
+    rec.hdr.size = sizeof(T);
+    taslog_write(&rec, sizeof(T));
+}
+
+#endif
@@ -0,0 +1,242 @@
+#include <cstring>
+#include "taslogcodec.hpp"
+
+// The index of a field among the 32-bit fields following the record header.
+#define FIELD(rectype, member) \
+    ((offsetof(rectype, member) - sizeof(taslog_rechdr_t)) / 4)
+
+// Fields not in either mask are floats, and the frame number, which are
+// extrapolated linearly from their last two values.  This is done on the bit
+// patterns as integers, both to stay exact and because the bit pattern of a
+// float grows steadily with its value for as long as the exponent and sign
+// stay the same.
+struct recinfo_t
+{
+    uint16_t size;
+    uint32_t delta_fields;      // integers compared with the last value
+    uint32_t xor_fields;        // bit masks
+};
+
+static const recinfo_t RECINFO[] = {
+    {0, 0, 0},
+    {sizeof(taslog_prethink_t), 0, 0},
+    {sizeof(taslog_pmove_pre_t),
+     1u << FIELD(taslog_pmove_pre_t, msec) |
+     1u << FIELD(taslog_pmove_pre_t, induck) |
+     1u << FIELD(taslog_pmove_pre_t, onground) |
+     1u << FIELD(taslog_pmove_pre_t, waterlevel),
+     1u << FIELD(taslog_pmove_pre_t, buttons) |
+     1u << FIELD(taslog_pmove_pre_t, flags)},
+    {sizeof(taslog_pmove_post_t),
+     1u << FIELD(taslog_pmove_post_t, numtouch) |
+     1u << FIELD(taslog_pmove_post_t, ladder) |
+     1u << FIELD(taslog_pmove_post_t, induck) |
+     1u << FIELD(taslog_pmove_post_t, onground) |
+     1u << FIELD(taslog_pmove_post_t, waterlevel),
+     1u << FIELD(taslog_pmove_post_t, flags)},
+    {sizeof(taslog_damage_t), 0, 1u << FIELD(taslog_damage_t, bits)},
+    {sizeof(taslog_yawspeed_t), 0, 0},
+};
+
+static const size_t STATE_FIELDS =
+    FIELD(taslog_pmove_post_t, waterlevel) -
+    FIELD(taslog_pmove_post_t, pos) + 1;
+static_assert(FIELD(taslog_pmove_pre_t, waterlevel) -
+              FIELD(taslog_pmove_pre_t, pos) + 1 == STATE_FIELDS,
+              "pmove_pre and pmove_post state fields differ");
+static_assert(sizeof(RECINFO) / sizeof(RECINFO[0]) == RecYawspeed + 1,
+              "RECINFO does not cover every record type");
+
+static inline uint32_t zigzag(uint32_t diff)
+{
+    return (diff << 1) ^ -(diff >> 31);
+}
+
+static inline uint32_t unzigzag(uint32_t code)
+{
+    return (code >> 1) ^ -(code & 1);
+}
+
+static inline char *put_varint(char *out, uint32_t value)
+{
+    while (value >= 0x80) {
+        *out++ = (char)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (char)value;
+    return out;
+}
+
+// Returns the position after the varint, nullptr if [p, end) stops in the
+// middle of it, or end + 1 if it is longer than a 32-bit value can be.
+static inline const char *get_varint(const char *p, const char *end,
+                                     uint32_t &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (p == end)
+            return nullptr;
+        unsigned char byte = *p++;
+        value |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return p;
+    }
+    return end + 1;
+}
+
+taslog_codec_t::taslog_codec_t()
+{
+    reset();
+}
+
+void taslog_codec_t::reset()
+{
+    std::memset(last, 0, sizeof(last));
+    std::memset(before_last, 0, sizeof(before_last));
+}
+
+uint32_t taslog_codec_t::predict(int type, int field) const
+{
+    const recinfo_t &info = RECINFO[type];
+    if ((info.delta_fields | info.xor_fields) >> field & 1)
+        return last[type][field];
+    return 2 * last[type][field] - before_last[type][field];
+}
+
+// A pmove_post record also gives the state at the next pmove_pre, which
+// should then be predicted to stay as it is.
+void taslog_codec_t::update(const uint32_t *fields, int type)
+{
+    size_t len = RECINFO[type].size - sizeof(taslog_rechdr_t);
+    std::memcpy(before_last[type], last[type], len);
+    std::memcpy(last[type], fields, len);
+    if (type == RecPmovePost) {
+        const uint32_t *state = fields + FIELD(taslog_pmove_post_t, pos);
+        size_t pos = FIELD(taslog_pmove_pre_t, pos);
+        std::memcpy(last[RecPmovePre] + pos, state, STATE_FIELDS * 4);
+        std::memcpy(before_last[RecPmovePre] + pos, state, STATE_FIELDS * 4);
+    }
+}
+
+size_t taslog_codec_t::encode(const void *rec, char *out)
+{
+    taslog_rechdr_t hdr;
+    std::memcpy(&hdr, rec, sizeof(hdr));
+    if (!hdr.type || hdr.type >= NUM_TYPES || hdr.size != RECINFO[hdr.type].size)
+        return 0;
+
+    uint32_t fields[MAX_FIELDS];
+    uint32_t codes[MAX_FIELDS];
+    int num_fields = (hdr.size - sizeof(hdr)) / 4;
+    std::memcpy(fields, (const char *)rec + sizeof(hdr), num_fields * 4);
+
+    uint32_t xor_fields = RECINFO[hdr.type].xor_fields;
+    uint32_t changed = 0;
+    for (int i = 0; i < num_fields; i++) {
+        uint32_t pred = predict(hdr.type, i);
+        if (xor_fields >> i & 1)
+            codes[i] = fields[i] ^ pred;
+        else
+            codes[i] = zigzag(fields[i] - pred);
+        if (codes[i])
+            changed |= 1u << i;
+    }
+
+    char *p = put_varint(out, hdr.type);
+    p = put_varint(p, changed);
+    for (int i = 0; i < num_fields; i++) {
+        if (codes[i])
+            p = put_varint(p, codes[i]);
+    }
+
+    update(fields, hdr.type);
+    return p - out;
+}
+
+ptrdiff_t taslog_codec_t::decode(const char *p, const char *end, void *rec)
+{
+    const char *start = p;
+    uint32_t type;
+    uint32_t changed;
+    p = get_varint(p, end, type);
+    if (!p)
+        return 0;
+    if (p > end || !type || type >= NUM_TYPES)
+        return -1;
+    p = get_varint(p, end, changed);
+    if (!p)
+        return 0;
+
+    taslog_rechdr_t hdr;
+    hdr.type = type;
+    hdr.size = RECINFO[type].size;
+    int num_fields = (hdr.size - sizeof(hdr)) / 4;
+    if (p > end || changed >> num_fields)
+        return -1;
+
+    uint32_t fields[MAX_FIELDS];
+    uint32_t xor_fields = RECINFO[type].xor_fields;
+    for (int i = 0; i < num_fields; i++) {
+        uint32_t code = 0;
+        if (changed >> i & 1) {
+            p = get_varint(p, end, code);
+            if (!p)
+                return 0;
+            if (p > end)
+                return -1;
+        }
+        uint32_t pred = predict(type, i);
+        if (xor_fields >> i & 1)
+            fields[i] = pred ^ code;
+        else
+            fields[i] = pred + unzigzag(code);
+    }
+
+    std::memcpy(rec, &hdr, sizeof(hdr));
+    std::memcpy((char *)rec + sizeof(hdr), fields, num_fields * 4);
+    update(fields, type);
+    return p - start;
+}
+
+taslog_reader_t::taslog_reader_t()
+    : ver(0)
+{
+}
+
+ptrdiff_t taslog_reader_t::read_header(const char *p, const char *end)
+{
+    taslog_filehdr_t hdr;
+    if ((size_t)(end - p) < sizeof(hdr))
+        return 0;
+    std::memcpy(&hdr, p, sizeof(hdr));
+    if (std::memcmp(hdr.magic, TASLOG_MAGIC, sizeof(hdr.magic)) != 0 ||
+        !hdr.version || hdr.version > TASLOG_VERSION ||
+        hdr.hdrsize < sizeof(hdr))
+        return -1;
+    if ((size_t)(end - p) < hdr.hdrsize)
+        return 0;
+
+    ver = hdr.version;
+    codec.reset();
+    return hdr.hdrsize;
+}
+
+ptrdiff_t taslog_reader_t::read_record(const char *p, const char *end,
+                                       void *rec)
+{
+    if (ver >= 2)
+        return codec.decode(p, end, rec);
+
+    // Version 1 stored the records as they are.
+    taslog_rechdr_t hdr;
+    if ((size_t)(end - p) < sizeof(hdr))
+        return 0;
+    std::memcpy(&hdr, p, sizeof(hdr));
+    if (!hdr.type || hdr.type > RecYawspeed ||
+        hdr.size != RECINFO[hdr.type].size)
+        return -1;
+    if (end - p < hdr.size)
+        return 0;
+    std::memcpy(rec, p, hdr.size);
+    return hdr.size;
+}
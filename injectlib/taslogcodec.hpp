@@ -0,0 +1,65 @@
+#ifndef TASLOGCODEC_H
+#define TASLOGCODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include "taslog.hpp"
+
+// From version 2 of the binary TAS log, each record is stored as a varint
+// holding its type, a varint with a bit set for each 32-bit field that differs
+// from its predicted value, and a varint for each such field.  Integers are
+// predicted to keep their last value and stored as the zigzag encoded
+// difference, and bit masks likewise but stored as the XOR with it.  Floats
+// and the frame number are extrapolated from their last two values instead,
+// which makes steady movement cost a few bytes per coordinate.  The player
+// state at a pmove_pre record is predicted from the last pmove_post, since the
+// player is normally where the previous frame left him.  Decoding must
+// therefore start from the first record and see every record in order.
+
+const size_t TASLOG_MAX_RECSIZE = sizeof(taslog_pmove_pre_t);
+const size_t TASLOG_MAX_ENCODED = 1 + 5 * (TASLOG_MAX_RECSIZE / 4);
+
+class taslog_codec_t
+{
+public:
+    taslog_codec_t();
+    void reset();
+
+    // Encode rec, which starts with a taslog_rechdr_t, into out.  Returns the
+    // encoded length, or 0 if the type or size of the record is unknown.
+    size_t encode(const void *rec, char *out);
+    // Decode the record at the start of [p, end) into rec, which must have
+    // room for TASLOG_MAX_RECSIZE bytes.  Returns the number of bytes used, 0
+    // if [p, end) stops in the middle of the record, or -1 if it is corrupt.
+    ptrdiff_t decode(const char *p, const char *end, void *rec);
+
+private:
+    uint32_t predict(int type, int field) const;
+    void update(const uint32_t *fields, int type);
+
+    static const int NUM_TYPES = RecYawspeed + 1;
+    static const int MAX_FIELDS = TASLOG_MAX_RECSIZE / 4;
+    uint32_t last[NUM_TYPES][MAX_FIELDS];
+    uint32_t before_last[NUM_TYPES][MAX_FIELDS];
+};
+
+// Reads the records of a log of any version out of a buffer, which may be
+// refilled between calls as long as nothing already read is passed again.
+class taslog_reader_t
+{
+public:
+    taslog_reader_t();
+
+    // Check the file header at the start of [p, end).  Returns its length, 0
+    // if more data is needed, or -1 if this is not a log of a known version.
+    ptrdiff_t read_header(const char *p, const char *end);
+    // Same as taslog_codec_t::decode, after a successful read_header.
+    ptrdiff_t read_record(const char *p, const char *end, void *rec);
+    uint32_t version() const { return ver; }
+
+private:
+    uint32_t ver;
+    taslog_codec_t codec;
+};
+
+#endif
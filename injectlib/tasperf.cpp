@@ -0,0 +1,95 @@
+#include <chrono>
+#include <cstring>
+#include "tasperf.hpp"
+
+cvar_t sv_tas_perf;
+perfstat_t perf_stats[NUM_PERF_HOOKS];
+
+#ifndef NO_TASPERF
+static const char *const HOOK_NAMES[NUM_PERF_HOOKS] = {
+    "CL_CreateMove",
+    "PM_Move",
+    "PM_FlyMove",
+    "PM_WalkMove",
+    "AddToFullPack",
+    "PlayerPreThink",
+    "CHudPlrInfo::Draw",
+    "SCR_UpdateScreen",
+    "PM_PlayerTrace",
+};
+
+// The TSC and the clock when the library was loaded, from which the TSC
+// frequency is worked out when printing.
+static const uint64_t load_tsc = __rdtsc();
+static const std::chrono::steady_clock::time_point load_time =
+    std::chrono::steady_clock::now();
+
+// The middle of the range of cycles counted in bucket.
+static double bucket_value(int bucket)
+{
+    if (bucket < PERF_SUBBUCKETS)
+        return bucket;
+    int e = bucket / PERF_SUBBUCKETS;
+    double width = (double)(1ULL << (e - 2));
+    return (PERF_SUBBUCKETS + bucket % PERF_SUBBUCKETS) * width + width / 2;
+}
+
+static double percentile(const perfstat_t &stat, uint64_t calls, double q)
+{
+    uint64_t target = (uint64_t)(q * calls);
+    uint64_t seen = 0;
+    for (int i = 0; i < PERF_BUCKETS; i++) {
+        seen += stat.buckets[i].load(std::memory_order_relaxed);
+        if (seen > target)
+            return bucket_value(i);
+    }
+    return bucket_value(PERF_BUCKETS - 1);
+}
+#endif
+
+static void reset_stats()
+{
+    for (int i = 0; i < NUM_PERF_HOOKS; i++) {
+        perfstat_t &stat = perf_stats[i];
+        stat.calls.store(0, std::memory_order_relaxed);
+        stat.max.store(0, std::memory_order_relaxed);
+        for (int j = 0; j < PERF_BUCKETS; j++)
+            stat.buckets[j].store(0, std::memory_order_relaxed);
+    }
+}
+
+static void print_stats()
+{
+#ifdef NO_TASPERF
+    orig_Con_Printf("TasTools was built without tas_perf.\n");
+#else
+    std::chrono::duration<double, std::micro> elapsed =
+        std::chrono::steady_clock::now() - load_time;
+    double cycles_per_us = (__rdtsc() - load_tsc) / elapsed.count();
+    if (!(cycles_per_us > 0))
+        return;
+
+    orig_Con_Printf("%-18s %10s %9s %9s %9s  (us, %.0f MHz TSC)\n", "hook",
+                    "calls", "p50", "p99", "max", cycles_per_us);
+    for (int i = 0; i < NUM_PERF_HOOKS; i++) {
+        const perfstat_t &stat = perf_stats[i];
+        uint64_t calls = stat.calls.load(std::memory_order_relaxed);
+        if (!calls)
+            continue;
+        orig_Con_Printf("%-18s %10llu %9.2f %9.2f %9.2f\n", HOOK_NAMES[i],
+                        (unsigned long long)calls,
+                        percentile(stat, calls, 0.5) / cycles_per_us,
+                        percentile(stat, calls, 0.99) / cycles_per_us,
+                        stat.max.load(std::memory_order_relaxed) /
+                        cycles_per_us);
+    }
+#endif
+}
+
+void tas_perf_cmd(const char *arg)
+{
+    if (std::strcmp(arg, "reset") == 0)
+        reset_stats();
+    else
+        print_stats();
+}
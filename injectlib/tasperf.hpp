@@ -0,0 +1,96 @@
+#ifndef TASPERF_H
+#define TASPERF_H
+
+#include <atomic>
+#include <cstdint>
+#include <x86intrin.h>
+#include "common.hpp"
+
+// Latency histograms of our hooks, measured with the TSC while sv_tas_perf is
+// nonzero and printed by tas_perf.  Building with -DNO_TASPERF compiles the
+// measurements out altogether.  Times are inclusive, so PM_Move contains the
+// PM_FlyMove and PM_WalkMove calls made within it.
+
+enum perf_hook_t
+{
+    PerfCL_CreateMove,
+    PerfPM_Move,
+    PerfPM_FlyMove,
+    PerfPM_WalkMove,
+    PerfAddToFullPack,
+    PerfPlayerPreThink,
+    PerfHudDraw,
+    PerfSCR_UpdateScreen,
+    PerfPlayerTrace,
+    NUM_PERF_HOOKS,
+};
+
+// Each power of two of cycles is split into four buckets, which bounds the
+// error of a percentile to an eighth of its value.
+const int PERF_SUBBUCKETS = 4;
+const int PERF_BUCKETS = 64 * PERF_SUBBUCKETS;
+
+// Only the engine thread records, so the counters are advanced with plain
+// relaxed loads and stores rather than locked instructions, while remaining
+// safe to read from any thread.
+struct perfstat_t
+{
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> max;
+    std::atomic<uint64_t> buckets[PERF_BUCKETS];
+};
+
+extern cvar_t sv_tas_perf;
+extern perfstat_t perf_stats[NUM_PERF_HOOKS];
+
+inline int perf_bucket(uint64_t cycles)
+{
+    if (cycles < PERF_SUBBUCKETS)
+        return (int)cycles;
+    int e = 63 - __builtin_clzll(cycles);
+    return e * PERF_SUBBUCKETS + (int)((cycles >> (e - 2)) & 3);
+}
+
+inline void perf_bump(std::atomic<uint64_t> &counter)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+}
+
+inline void perf_record(perf_hook_t hook, uint64_t cycles)
+{
+    perfstat_t &stat = perf_stats[hook];
+    perf_bump(stat.calls);
+    perf_bump(stat.buckets[perf_bucket(cycles)]);
+    if (cycles > stat.max.load(std::memory_order_relaxed))
+        stat.max.store(cycles, std::memory_order_relaxed);
+}
+
+// Times its own lifetime as a call of hook.
+class perf_scope_t
+{
+public:
+#ifdef NO_TASPERF
+    explicit perf_scope_t(perf_hook_t) {}
+#else
+    explicit perf_scope_t(perf_hook_t hook)
+        : hook(hook), start(sv_tas_perf.value ? __rdtsc() : 0) {}
+
+    ~perf_scope_t()
+    {
+        if (start)
+            perf_record(hook, __rdtsc() - start);
+    }
+
+private:
+    perf_hook_t hook;
+    uint64_t start;
+#endif
+};
+
+// The tas_perf command.  With no argument, print the call count and the
+// median, 99th percentile and largest latency of every hook since the last
+// reset.  With "reset", clear them.
+void tas_perf_cmd(const char *arg);
+
+#endif
@@ -0,0 +1,87 @@
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+#include "legitgen.hpp"
+
+static const char USAGE[] =
+    "Usage: genlegit [--prepend CMDS] [--append CMDS] [--hfrval FRAMETIME]\n"
+    "                [--noendhfr] [--save SAVE] [--record DEMO]\n"
+    "                [--output PREFIX [--lines N]] [log]\n"
+    "\n"
+    "Generate the legitimate script from a TAS log written with sv_taslog 1,\n"
+    "read from the file given or from the standard input.  The script is\n"
+    "printed, or written to PREFIX.cfg if --output is given, continuing in\n"
+    "PREFIX1.cfg and so on every N lines if --lines is given too.\n";
+
+int main(int argc, char *argv[])
+{
+    static const option longopts[] = {
+        {"prepend", required_argument, nullptr, 'p'},
+        {"append", required_argument, nullptr, 'a'},
+        {"hfrval", required_argument, nullptr, 'f'},
+        {"noendhfr", no_argument, nullptr, 'n'},
+        {"save", required_argument, nullptr, 's'},
+        {"record", required_argument, nullptr, 'r'},
+        {"output", required_argument, nullptr, 'o'},
+        {"lines", required_argument, nullptr, 'l'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    legitopts_t opts = LEGIT_DEFAULT_OPTS;
+    const char *prefix = nullptr;
+    long lines_per_file = 0;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", longopts, nullptr)) != -1) {
+        switch (opt) {
+        case 'p':
+            opts.prepend = optarg;
+            break;
+        case 'a':
+            opts.append = optarg;
+            break;
+        case 'f':
+            opts.hfrval = optarg;
+            break;
+        case 'n':
+            opts.endhfr = false;
+            break;
+        case 's':
+            opts.save = optarg;
+            break;
+        case 'r':
+            opts.record = optarg;
+            break;
+        case 'o':
+            prefix = optarg;
+            break;
+        case 'l':
+            lines_per_file = std::atol(optarg);
+            if (lines_per_file < 1) {
+                std::fputs("The number of lines must be >= 1.\n", stderr);
+                return 1;
+            }
+            break;
+        default:
+            std::fputs(USAGE, stderr);
+            return opt != 'h';
+        }
+    }
+
+    std::FILE *log = stdin;
+    if (optind < argc) {
+        log = std::fopen(argv[optind], "r");
+        if (!log) {
+            std::fprintf(stderr, "Failed to open %s.\n", argv[optind]);
+            return 1;
+        }
+    }
+
+    if (prefix) {
+        scriptout_t out(prefix, lines_per_file);
+        return !gen_legit(log, opts, out);
+    }
+    scriptout_t out(stdout);
+    return !gen_legit(log, opts, out);
+}
@@ -0,0 +1,349 @@
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "legitgen.hpp"
+
+static const double AM_U_2 = 360.0 / 65536 / 2;
+
+static const unsigned int IN_ATTACK = 1 << 0;
+static const unsigned int IN_JUMP = 1 << 1;
+static const unsigned int IN_DUCK = 1 << 2;
+static const unsigned int IN_FORWARD = 1 << 3;
+static const unsigned int IN_BACK = 1 << 4;
+static const unsigned int IN_USE = 1 << 5;
+static const unsigned int IN_MOVELEFT = 1 << 9;
+static const unsigned int IN_MOVERIGHT = 1 << 10;
+static const unsigned int IN_ATTACK2 = 1 << 11;
+static const unsigned int IN_RELOAD = 1 << 13;
+
+// In the order genlegit.py emits them.
+static const struct
+{
+    unsigned int bit;
+    const char *name;
+} BUTTONS[] = {
+    {IN_FORWARD, "forward"},
+    {IN_MOVERIGHT, "moveright"},
+    {IN_MOVELEFT, "moveleft"},
+    {IN_BACK, "back"},
+    {IN_USE, "use"},
+    {IN_ATTACK, "attack"},
+    {IN_ATTACK2, "attack2"},
+    {IN_RELOAD, "reload"},
+    {IN_DUCK, "duck"},
+    {IN_JUMP, "jump"},
+};
+
+static const char SIGNON_LINE[] = "CL_SignonReply: 2";
+
+static inline bool is_space(char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static inline bool starts_with(const char *line, size_t len,
+                               const char *prefix)
+{
+    size_t n = std::strlen(prefix);
+    return len >= n && std::memcmp(line, prefix, n) == 0;
+}
+
+// The nth whitespace separated token of the line, or an empty string.
+static std::string token(const char *line, size_t len, int n)
+{
+    size_t i = 0;
+    for (;;) {
+        while (i < len && is_space(line[i]))
+            i++;
+        size_t start = i;
+        while (i < len && !is_space(line[i]))
+            i++;
+        if (start == i)
+            return std::string();
+        if (!n--)
+            return std::string(line + start, i - start);
+    }
+}
+
+// Format value as Python's repr does, which is how genlegit.py prints the
+// values it computes: the fewest digits that read back as the same value,
+// and positional notation for exponents from -4 up to 15.
+static std::string repr(double value)
+{
+    if (std::isnan(value))
+        return "nan";
+    if (std::isinf(value))
+        return value < 0 ? "-inf" : "inf";
+
+    char buf[32];
+    for (int prec = 0; prec <= 16; prec++) {
+        std::snprintf(buf, sizeof(buf), "%.*e", prec, value);
+        if (std::strtod(buf, nullptr) == value)
+            break;
+    }
+
+    // buf now reads [-]D[.DDD]e(+|-)XX.
+    const char *p = buf;
+    std::string result;
+    if (*p == '-')
+        result += *p++;
+    std::string digits;
+    for (; *p != 'e'; p++) {
+        if (*p != '.')
+            digits += *p;
+    }
+    int exp = std::atoi(p + 1);
+    int ndigits = digits.length();
+
+    if (exp < -4 || exp >= 16) {
+        result += digits[0];
+        if (ndigits > 1)
+            result += '.' + digits.substr(1);
+        std::snprintf(buf, sizeof(buf), "e%c%02d", exp < 0 ? '-' : '+',
+                      std::abs(exp));
+        return result + buf;
+    }
+    if (exp < 0)
+        return result + "0." + std::string(-exp - 1, '0') + digits;
+    if (exp >= ndigits - 1)
+        return result + digits + std::string(exp - ndigits + 1, '0') + ".0";
+    return result + digits.substr(0, exp + 1) + '.' +
+        digits.substr(exp + 1);
+}
+
+scriptout_t::scriptout_t(std::FILE *stream)
+    : stream(stream), owns_stream(false), failed(false), lines_per_file(0),
+      num_lines(0), file_num(0)
+{
+}
+
+scriptout_t::scriptout_t(const std::string &prefix, long lines_per_file)
+    : stream(nullptr), owns_stream(true), failed(false), prefix(prefix),
+      lines_per_file(lines_per_file), num_lines(0), file_num(0)
+{
+}
+
+scriptout_t::~scriptout_t()
+{
+    close();
+}
+
+bool scriptout_t::open_next()
+{
+    std::string path = prefix;
+    if (file_num)
+        path += std::to_string(file_num);
+    path += ".cfg";
+    file_num++;
+
+    if (stream) {
+        size_t slash = path.find_last_of('/');
+        size_t name = slash == std::string::npos ? 0 : slash + 1;
+        std::fprintf(stream, "exec \"%s\"\n", path.c_str() + name);
+        failed |= std::fclose(stream) != 0;
+    }
+    stream = std::fopen(path.c_str(), "w");
+    if (!stream) {
+        std::fprintf(stderr, "Failed to open %s.\n", path.c_str());
+        failed = true;
+        return false;
+    }
+    num_lines = 0;
+    return true;
+}
+
+void scriptout_t::put_line(const char *text, size_t len)
+{
+    if (failed || (!stream && !open_next()))
+        return;
+    std::fwrite(text, 1, len, stream);
+    std::fputc('\n', stream);
+    if (owns_stream && lines_per_file && ++num_lines == lines_per_file)
+        open_next();
+}
+
+void scriptout_t::line(const char *text)
+{
+    line(text, std::strlen(text));
+}
+
+void scriptout_t::line(const char *text, size_t len)
+{
+    const char *end = text + len;
+    for (;;) {
+        const char *nl = (const char *)std::memchr(text, '\n', end - text);
+        if (!nl)
+            break;
+        put_line(text, nl - text);
+        text = nl + 1;
+    }
+    put_line(text, end - text);
+}
+
+bool scriptout_t::close()
+{
+    if (stream) {
+        if (owns_stream)
+            failed |= std::fclose(stream) != 0;
+        else
+            failed |= std::fflush(stream) != 0 || std::ferror(stream);
+        stream = nullptr;
+    }
+    return !failed;
+}
+
+legitgen_t::legitgen_t(const legitopts_t &opts, scriptout_t &out)
+    : opts(opts), out(out), signed_on(false), frametime(0),
+      backspd_sign('-'), commands(0), have_pitch(false), pitch(0)
+{
+}
+
+void legitgen_t::begin()
+{
+    if (opts.prepend)
+        out.line(opts.prepend);
+    if (opts.record)
+        out.line(("record " + std::string(opts.record)).c_str());
+    out.line("+left");
+    out.line("cl_yawspeed 0");
+    out.line("cl_forwardspeed 10000");
+    out.line("cl_backspeed 10000");
+    out.line("cl_sidespeed 10000");
+    out.line("cl_upspeed 10000");
+}
+
+void legitgen_t::feed_prethink(const char *line, size_t len)
+{
+    // The frame time is the last token.
+    size_t end = len;
+    while (end && is_space(line[end - 1]))
+        end--;
+    size_t start = end;
+    while (start && !is_space(line[start - 1]))
+        start--;
+    double new_frametime = std::strtod(
+        std::string(line + start, end - start).c_str(), nullptr);
+    if (!new_frametime)
+        return;
+
+    if (new_frametime != frametime) {
+        out.line(("host_framerate " + repr(new_frametime)).c_str());
+        frametime = new_frametime;
+    }
+    out.line("wait");
+    if (!yawspeed_line.empty())
+        out.line(yawspeed_line.data(), yawspeed_line.length());
+}
+
+void legitgen_t::feed_usercmd(const char *line, size_t len)
+{
+    double new_pitch = std::strtod(token(line, len, 3).c_str(), nullptr);
+    if (!have_pitch || new_pitch != pitch) {
+        double adjpitch = new_pitch + std::copysign(AM_U_2, new_pitch);
+        out.line(("cl_pitchup " + repr(-adjpitch)).c_str());
+        out.line(("cl_pitchdown " + repr(adjpitch)).c_str());
+        pitch = new_pitch;
+        have_pitch = true;
+    }
+
+    unsigned int buttons = std::strtoul(token(line, len, 2).c_str(), nullptr,
+                                        10);
+    for (const auto &button : BUTTONS) {
+        unsigned int newv = buttons & button.bit;
+        if (newv == (commands & button.bit))
+            continue;
+        out.line(((newv ? "+" : "-") + std::string(button.name)).c_str());
+        commands ^= button.bit;
+    }
+}
+
+// genlegit.py compares the first character of the forward move rather than
+// only its sign, so this does the same.
+void legitgen_t::feed_fsu(const char *line, size_t len)
+{
+    std::string fmove = token(line, len, 1);
+    if (fmove.empty() || fmove[0] == backspd_sign)
+        return;
+    out.line(fmove[0] == '-' ? "cl_backspeed 10000" : "cl_backspeed -10000");
+    backspd_sign = fmove[0];
+}
+
+void legitgen_t::feed(const char *line, size_t len)
+{
+    if (len && line[len - 1] == '\n')
+        len--;
+
+    if (!signed_on) {
+        size_t end = len;
+        while (end && is_space(line[end - 1]))
+            end--;
+        if (end == sizeof(SIGNON_LINE) - 1 &&
+            std::memcmp(line, SIGNON_LINE, end) == 0) {
+            signed_on = true;
+            begin();
+        }
+        return;
+    }
+
+    if (starts_with(line, len, "prethink"))
+        feed_prethink(line, len);
+    else if (starts_with(line, len, "cl_yawspeed"))
+        yawspeed_line.assign(line, len);
+    else if (starts_with(line, len, "weapon_"))
+        out.line(line, len);
+    else if (starts_with(line, len, "usercmd"))
+        feed_usercmd(line, len);
+    else if (commands & IN_BACK && starts_with(line, len, "fsu"))
+        feed_fsu(line, len);
+}
+
+bool legitgen_t::finish()
+{
+    if (!signed_on)
+        return false;
+
+    if (opts.endhfr)
+        out.line(("host_framerate " + std::string(opts.hfrval)).c_str());
+    out.line("wait");
+    out.line("-use");
+    out.line("-attack");
+    out.line("-attack2");
+    out.line("-reload");
+    out.line("-jump");
+    out.line("-duck");
+    out.line("-left");
+    out.line("-forward");
+    out.line("-moveleft");
+    out.line("-moveright");
+    out.line("-back");
+    if (opts.record)
+        out.line("stop");
+    if (opts.save)
+        out.line(("save " + std::string(opts.save)).c_str());
+    out.line("echo TASEND");
+    if (opts.append)
+        out.line(opts.append);
+    return true;
+}
+
+bool gen_legit(std::FILE *in, const legitopts_t &opts, scriptout_t &out)
+{
+    legitgen_t gen(opts, out);
+    char *line = nullptr;
+    size_t cap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &cap, in)) != -1)
+        gen.feed(line, len);
+    std::free(line);
+
+    if (!gen.finish()) {
+        std::fputs("ERROR: Couldn't find \"CL_SignonReply: 2\"\n", stderr);
+        return false;
+    }
+    if (!out.close()) {
+        std::fputs("ERROR: Failed to write the script\n", stderr);
+        return false;
+    }
+    return true;
+}
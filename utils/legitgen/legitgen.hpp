@@ -0,0 +1,91 @@
+#ifndef LEGITGEN_H
+#define LEGITGEN_H
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+// Conversion of a TAS log written with sv_taslog 1 into the legitimate script,
+// producing the same script as genlegit.py piped into splitscript.py.  The log
+// is taken a line at a time, so memory use does not grow with its length.
+
+struct legitopts_t
+{
+    const char *prepend;        // commands before the script, or nullptr
+    const char *append;         // commands after TASEND, or nullptr
+    const char *hfrval;         // host_framerate before the final wait
+    bool endhfr;                // whether to set that host_framerate at all
+    const char *save;           // save name at the end, or nullptr
+    const char *record;         // demo recording the script, or nullptr
+};
+
+const legitopts_t LEGIT_DEFAULT_OPTS = {
+    nullptr, nullptr, "0.0001", true, nullptr, nullptr
+};
+
+// Where the script goes: either a stream, or PREFIX.cfg followed by
+// PREFIX1.cfg, PREFIX2.cfg and so on, each holding lines_per_file lines and
+// then an exec of the next file.  Files are created on the first line.
+class scriptout_t
+{
+public:
+    explicit scriptout_t(std::FILE *stream);
+    scriptout_t(const std::string &prefix, long lines_per_file);
+    ~scriptout_t();
+
+    // Write text and a newline.  Newlines within text start new lines too.
+    void line(const char *text);
+    void line(const char *text, size_t len);
+    // Returns false if anything could not be written.
+    bool close();
+
+private:
+    scriptout_t(const scriptout_t &) = delete;
+    scriptout_t &operator=(const scriptout_t &) = delete;
+
+    void put_line(const char *text, size_t len);
+    bool open_next();
+
+    std::FILE *stream;
+    bool owns_stream;
+    bool failed;
+    std::string prefix;
+    long lines_per_file;
+    long num_lines;
+    long file_num;
+};
+
+class legitgen_t
+{
+public:
+    legitgen_t(const legitopts_t &opts, scriptout_t &out);
+
+    // Feed the next line of the log, with or without its newline.
+    void feed(const char *line, size_t len);
+    // Write the end of the script.  Returns false if the log never reached
+    // CL_SignonReply: 2, in which case nothing has been written at all.
+    bool finish();
+
+private:
+    void begin();
+    void feed_prethink(const char *line, size_t len);
+    void feed_usercmd(const char *line, size_t len);
+    void feed_fsu(const char *line, size_t len);
+
+    const legitopts_t opts;
+    scriptout_t &out;
+    bool signed_on;
+    double frametime;
+    std::string yawspeed_line;
+    char backspd_sign;
+    unsigned int commands;
+    bool have_pitch;
+    double pitch;
+};
+
+// Convert the whole log read from in.  Returns false with a message on stderr
+// if the log never reached CL_SignonReply: 2 or the script could not be
+// written.
+bool gen_legit(std::FILE *in, const legitopts_t &opts, scriptout_t &out);
+
+#endif
@@ -1,11 +1,15 @@
 #include <QBrush>
 #include <QFile>
+#include <QHash>
 #include <QTextStream>
+#include <QThread>
 #include <QDebug>
+#include <QtConcurrent>
 #include <cmath>
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
+#include <sys/stat.h>
 #include "logtablemodel.h"
 
 using std::hypot;
@@ -51,11 +55,635 @@ static const QBrush brushCyan = QBrush(QColor(80, 255, 255));
 static const QBrush brushYellow = QBrush(QColor(255, 230, 100));
 static const QBrush brushBrown = QBrush(QColor(180, 100, 0));
 
+// Logs are cut into several chunks per thread so that threads which finish
+// early can pick up more work, but never into chunks much smaller than
+// MIN_CHUNK_SIZE.
+static const int CHUNKS_PER_THREAD = 4;
+static const qint64 MIN_CHUNK_SIZE = 1 << 20;
+
+// What feedLine did with a line.
+enum LineResult
+{
+    LINE_NEWFRAME,
+    LINE_CONSUMED,
+    LINE_IGNORED,
+    LINE_EXTRA,
+};
+
+static inline bool startsWith(const char *line, int len, const char *prefix,
+                              int n)
+{
+    return len >= n && std::memcmp(line, prefix, n) == 0;
+}
+
+// Whether the first space separated token after line[n] starts with c, which
+// is what strtok_r followed by a *tok comparison checks.
+static inline bool tokenStartsWith(const char *line, int len, int n, char c)
+{
+    while (n < len && line[n] == ' ')
+        n++;
+    return n < len && line[n] == c;
+}
+
+// 2 if fully ducked, 1 if in the middle of ducking, 0 otherwise.
+static inline char duckState(bool bInDuck, unsigned long flags)
+{
+    if (flags & FL_DUCKING)
+        return 2;
+    return bInDuck ? 1 : 0;
+}
+
+// Feed one line to the readState machine, decoding its values into the last
+// row of table.  lineptr must be a NUL terminated copy of the line.
+static LineResult feedLine(ParseState &st, char *lineptr, int len,
+                           LogTable &table)
+{
+#define STARTTOK(n) tok = strtok_r(lineptr + (n), " ", &saveptr);
+#define NEXTTOK tok = strtok_r(NULL, " ", &saveptr);
+
+    char *saveptr;
+    char *tok;
+
+    switch (st.readState) {
+    case 0:
+        if (startsWith(lineptr, len, "prethink", 8)) {
+            STARTTOK(8);
+            unsigned int frameNum = std::atoi(tok);
+            NEXTTOK;
+            table.appendRow(frameNum, 1 / std::atof(tok));
+            st.readState = 1;
+            return LINE_NEWFRAME;
+        } else if (startsWith(lineptr, len, "dmg", 3)) {
+            STARTTOK(3);
+            float dmg = std::atof(tok);
+            NEXTTOK;
+            unsigned long bits = std::strtoul(tok, NULL, 10);
+            table.damages[table.rowCount() - 1] =
+                qMakePair(dmg, (unsigned int)bits);
+            return LINE_CONSUMED;
+        } else if (startsWith(lineptr, len, "obj", 3)) {
+            STARTTOK(3);
+            bool push = *tok != '0';
+            NEXTTOK;
+            float velx = std::atof(tok);
+            NEXTTOK;
+            float vely = std::atof(tok);
+            table.objmoves[table.rowCount() - 1] =
+                std::make_tuple(push, velx, vely);
+            return LINE_CONSUMED;
+        } else if (startsWith(lineptr, len, "expld", 5)) {
+            float start[3];
+            STARTTOK(5);
+            start[0] = std::atof(tok);
+            NEXTTOK;
+            start[1] = std::atof(tok);
+            NEXTTOK;
+            start[2] = std::atof(tok);
+
+            float end[3];
+            NEXTTOK;
+            NEXTTOK;
+            NEXTTOK;
+            NEXTTOK;
+            end[0] = std::atof(tok);
+            NEXTTOK;
+            end[1] = std::atof(tok);
+            NEXTTOK;
+            end[2] = std::atof(tok);
+
+            float disp[3] = {end[0] - start[0], end[1] - start[1],
+                             end[2] - start[2]};
+            table.explddists[table.rowCount() - 1] = sqrt(
+                disp[0] * disp[0] + disp[1] * disp[1] + disp[2] * disp[2]);
+            return LINE_CONSUMED;
+        }
+        break;
+    case 1:
+        if (!startsWith(lineptr, len, "health", 6))
+            break;
+        STARTTOK(6);
+        table.hp.last() = std::atof(tok);
+        NEXTTOK;
+        table.ap.last() = std::atof(tok);
+        st.readState = 2;
+        return LINE_CONSUMED;
+    case 2:
+        if (!startsWith(lineptr, len, "usercmd", 7))
+            break;
+        STARTTOK(7);
+        table.msec.last() = std::atoi(tok);
+        NEXTTOK;
+        table.buttons.last() = std::strtoul(tok, NULL, 10);
+        NEXTTOK;
+        table.pitch.last() = std::atof(tok);
+        NEXTTOK;
+        table.yaw.last() = std::atof(tok);
+        st.readState = 3;
+        return LINE_CONSUMED;
+    case 3:
+        if (!startsWith(lineptr, len, "fsu", 3))
+            break;
+        STARTTOK(3);
+        table.fmove.last() = std::atoi(tok);
+        NEXTTOK;
+        table.smove.last() = std::atoi(tok);
+        NEXTTOK;
+        table.umove.last() = std::atoi(tok);
+        st.readState = 4;
+        return LINE_CONSUMED;
+    case 4:
+        if (!startsWith(lineptr, len, "fg", 2))
+            break;
+        st.readState = 5;
+        return LINE_CONSUMED;
+    case 5: {
+        if (!startsWith(lineptr, len, "pa", 2))
+            break;
+        float tmppangs[2];
+        STARTTOK(2);
+        tmppangs[0] = std::atof(tok);
+        NEXTTOK;
+        tmppangs[1] = std::atof(tok);
+        if (tmppangs[0] || tmppangs[1])
+            table.punchangles[table.rowCount() - 1] =
+                qMakePair(tmppangs[0], tmppangs[1]);
+        st.readState = 6;
+        return LINE_CONSUMED;
+    }
+    case 6:
+        if (!startsWith(lineptr, len, "pmove", 5) ||
+            !tokenStartsWith(lineptr, len, 5, '1'))
+            break;
+        STARTTOK(5);
+        NEXTTOK;
+        NEXTTOK;
+        NEXTTOK;
+        NEXTTOK;
+        st.basevel[0] = std::atof(tok);
+        NEXTTOK;
+        st.basevel[1] = std::atof(tok);
+        NEXTTOK;
+        st.basevel[2] = std::atof(tok);
+        if (st.basevel[2])
+            table.vbasevels[table.rowCount() - 1] = st.basevel[2];
+        st.readState = 7;
+        return LINE_CONSUMED;
+    case 7:
+        if (!startsWith(lineptr, len, "ntl", 3))
+            break;
+        STARTTOK(3);
+        table.numtouch.last() = *tok != '0';
+        NEXTTOK;
+        table.ladder.last() = *tok != '0';
+        st.readState = 8;
+        return LINE_CONSUMED;
+    case 8:
+        if (!startsWith(lineptr, len, "pos", 3) ||
+            !tokenStartsWith(lineptr, len, 3, '2'))
+            break;
+        STARTTOK(3);
+        NEXTTOK;
+        table.posx.last() = std::atof(tok);
+        NEXTTOK;
+        table.posy.last() = std::atof(tok);
+        NEXTTOK;
+        table.posz.last() = std::atof(tok);
+        st.readState = 9;
+        return LINE_CONSUMED;
+    case 9: {
+        if (!startsWith(lineptr, len, "pmove", 5) ||
+            !tokenStartsWith(lineptr, len, 5, '2'))
+            break;
+        float vel[3];
+        STARTTOK(5);
+        NEXTTOK;
+        vel[0] = std::atof(tok);
+        NEXTTOK;
+        vel[1] = std::atof(tok);
+        NEXTTOK;
+        vel[2] = std::atof(tok);
+        table.hspd.last() = hypotf(vel[0], vel[1]);
+        table.ang.last() = atan2f(vel[1], vel[0]) * M_RAD2DEG;
+        table.vspd.last() = vel[2];
+
+        NEXTTOK;
+        NEXTTOK;
+        NEXTTOK;
+        NEXTTOK;
+        bool bInDuck = *tok != '0';
+        NEXTTOK;
+        table.dst.last() = duckState(bInDuck, std::strtoul(tok, NULL, 10));
+
+        NEXTTOK;
+        table.og.last() = std::atoi(tok) != -1;
+        NEXTTOK;
+        table.wlvl.last() = std::atoi(tok);
+        if (st.basevel[0] || st.basevel[1]) {
+            vel[0] += st.basevel[0];
+            vel[1] += st.basevel[1];
+            table.hbasevels[table.rowCount() - 1] = qMakePair(
+                hypotf(vel[0], vel[1]),
+                atan2f(vel[1], vel[0]) * M_RAD2DEG);
+        }
+        st.readState = 0;
+        return LINE_CONSUMED;
+    }
+    }
+
+    if (startsWith(lineptr, len, "pos", 3) ||
+        startsWith(lineptr, len, "cl_yawspeed", 11) ||
+        startsWith(lineptr, len, "execing", 7))
+        return LINE_IGNORED;
+
+    return LINE_EXTRA;
+
+#undef STARTTOK
+#undef NEXTTOK
+}
+
+// Parse the lines in [begin, end) into table, starting from st.  The range
+// must end right after a newline.
+static void parseLines(const char *begin, const char *end, ParseState &st,
+                       LogTable &table)
+{
+    QByteArray line;
+    const char *p = begin;
+    while (p < end) {
+        const char *nl = (const char *)std::memchr(p, '\n', end - p);
+        const char *lineEnd = nl ? nl + 1 : end;
+        line = QByteArray(p, lineEnd - p);
+        if (feedLine(st, line.data(), line.length(), table) == LINE_EXTRA)
+            table.extralines[table.rowCount() - 1].append(line);
+        p = lineEnd;
+    }
+}
+
+// The end of the last complete line in [begin, end).  Anything after it is
+// left alone since the game may still be writing it.
+static const char *completeLinesEnd(const char *begin, const char *end)
+{
+    const char *nl = (const char *)memrchr(begin, '\n', end - begin);
+    return nl ? nl + 1 : begin;
+}
+
+// Lines before the first prethink are shown along with the first row.
+static void foldPreamble(LogTable &table)
+{
+    if (!table.rowCount() || !table.extralines.contains(-1))
+        return;
+    QStringList lines = table.extralines.value(-1);
+    lines.append(table.extralines.value(0));
+    table.extralines.remove(-1);
+    table.extralines[0] = lines;
+}
+
+// There is a change list for every column, plus one for numtouch which is
+// not shown as a column of its own.
+static const int CHANGES_NUMTOUCH = LogTableModel::HEAD_LENGTH;
+static const int NUM_CHANGE_LISTS = LogTableModel::HEAD_LENGTH + 1;
+
+template<typename T>
+static void indexColumn(QVector<int> &changes, const QVector<T> &column,
+                        int from, int to)
+{
+    const T *value = column.constData();
+    for (int row = qMax(from, 1); row < to; row++) {
+        if (value[row] != value[row - 1])
+            changes.append(row);
+    }
+}
+
+static void indexButton(QVector<int> &changes,
+                        const QVector<unsigned int> &buttons,
+                        unsigned int bit, int from, int to)
+{
+    const unsigned int *value = buttons.constData();
+    for (int row = qMax(from, 1); row < to; row++) {
+        if ((value[row] & bit) != (value[row - 1] & bit))
+            changes.append(row);
+    }
+}
+
+// Add the rows in [from, to) that differ from the row before to the change
+// lists.
+static void indexRows(LogTable &table, int from, int to)
+{
+    table.changes.resize(NUM_CHANGE_LISTS);
+    QVector<int> *changes = table.changes.data();
+    indexColumn(changes[LogTableModel::HEAD_FRATE], table.frate, from, to);
+    indexColumn(changes[LogTableModel::HEAD_MSEC], table.msec, from, to);
+    indexColumn(changes[LogTableModel::HEAD_HP], table.hp, from, to);
+    indexColumn(changes[LogTableModel::HEAD_AP], table.ap, from, to);
+    indexColumn(changes[LogTableModel::HEAD_HSPD], table.hspd, from, to);
+    indexColumn(changes[LogTableModel::HEAD_ANG], table.ang, from, to);
+    indexColumn(changes[LogTableModel::HEAD_VSPD], table.vspd, from, to);
+    indexColumn(changes[LogTableModel::HEAD_OG], table.og, from, to);
+    indexColumn(changes[LogTableModel::HEAD_DST], table.dst, from, to);
+    indexButton(changes[LogTableModel::HEAD_DUCK], table.buttons, IN_DUCK,
+                from, to);
+    indexButton(changes[LogTableModel::HEAD_JUMP], table.buttons, IN_JUMP,
+                from, to);
+    indexColumn(changes[LogTableModel::HEAD_FMOVE], table.fmove, from, to);
+    indexColumn(changes[LogTableModel::HEAD_SMOVE], table.smove, from, to);
+    indexColumn(changes[LogTableModel::HEAD_UMOVE], table.umove, from, to);
+    indexColumn(changes[LogTableModel::HEAD_YAW], table.yaw, from, to);
+    indexColumn(changes[LogTableModel::HEAD_PITCH], table.pitch, from, to);
+    indexButton(changes[LogTableModel::HEAD_USE], table.buttons, IN_USE,
+                from, to);
+    indexButton(changes[LogTableModel::HEAD_ATTACK], table.buttons,
+                IN_ATTACK, from, to);
+    indexButton(changes[LogTableModel::HEAD_ATTACK2], table.buttons,
+                IN_ATTACK2, from, to);
+    indexButton(changes[LogTableModel::HEAD_RELOAD], table.buttons,
+                IN_RELOAD, from, to);
+    indexColumn(changes[LogTableModel::HEAD_WLVL], table.wlvl, from, to);
+    indexColumn(changes[LogTableModel::HEAD_LADDER], table.ladder, from, to);
+    indexColumn(changes[LogTableModel::HEAD_POSX], table.posx, from, to);
+    indexColumn(changes[LogTableModel::HEAD_POSY], table.posy, from, to);
+    indexColumn(changes[LogTableModel::HEAD_POSZ], table.posz, from, to);
+    indexColumn(changes[CHANGES_NUMTOUCH], table.numtouch, from, to);
+}
+
+// Bring the change lists up to date with the rows parsed since the last
+// call.  The last row seen then may have been filled in further since, so it
+// is looked at again.
+static void indexChanges(LogTable &table)
+{
+    int from = qMax(table.indexedRows - 1, 1);
+    for (QVector<int> &changes : table.changes) {
+        while (!changes.isEmpty() && changes.last() >= from)
+            changes.removeLast();
+    }
+    indexRows(table, from, table.rowCount());
+    table.indexedRows = table.rowCount();
+}
+
+// The nearest row after or before row whose value differs from that of row,
+// or -1 if there is none.
+static int findChange(const QVector<int> &changes, int row, bool forward)
+{
+    auto it = std::upper_bound(changes.constBegin(), changes.constEnd(), row);
+    if (forward)
+        return it == changes.constEnd() ? -1 : *it;
+
+    // Every row from the last change up to row has the same value.
+    return it == changes.constBegin() ? -1 : *(it - 1) - 1;
+}
+
+struct LogChunk
+{
+    const char *begin;
+    const char *end;
+};
+
+// A chunk parsed as though it were the start of the log.
+struct ChunkResult
+{
+    LogChunk chunk;
+    LogTable table;
+    ParseState st;
+};
+
+// Cut [begin, end) into chunks, each starting at a prethink line except for
+// the first.
+static QVector<LogChunk> splitLog(const char *begin, const char *end)
+{
+    qint64 size = end - begin;
+    int numChunks = qMin<qint64>(
+        QThread::idealThreadCount() * CHUNKS_PER_THREAD,
+        size / MIN_CHUNK_SIZE + 1);
+
+    QVector<LogChunk> chunks;
+    const char *chunkBegin = begin;
+    for (int i = 1; i < numChunks; i++) {
+        const char *p = begin + size * i / numChunks;
+        if (p <= chunkBegin)
+            continue;
+        const char *next = (const char *)memmem(p - 1, end - (p - 1),
+                                                "\nprethink", 9);
+        if (!next)
+            break;
+        chunks.append({chunkBegin, next + 1});
+        chunkBegin = next + 1;
+    }
+    if (chunkBegin < end)
+        chunks.append({chunkBegin, end});
+    return chunks;
+}
+
+static ChunkResult parseChunk(const LogChunk &chunk)
+{
+    ChunkResult result;
+    result.chunk = chunk;
+    parseLines(chunk.begin, chunk.end, result.st, result.table);
+    indexChanges(result.table);
+    return result;
+}
+
+// Called on the chunks in order, one at a time.  A chunk starts with a new
+// frame only if everything before it left the readState machine idle, which
+// is nearly always the case.  Otherwise its prethink line belongs to the
+// previous frame, so the chunk is parsed again carrying on from there.
+static void mergeChunk(LogLoad &load, const ChunkResult &result)
+{
+    if (load.st.readState != 0) {
+        parseLines(result.chunk.begin, result.chunk.end, load.st, load.table);
+        indexChanges(load.table);
+        return;
+    }
+
+    // The chunk has indexed its own rows, which leaves only its first row to
+    // be compared with the one before it.
+    int base = load.table.rowCount();
+    load.table.append(result.table);
+    indexRows(load.table, base, base + 1);
+    for (int i = 0; i < NUM_CHANGE_LISTS; i++) {
+        for (int row : result.table.changes[i])
+            load.table.changes[i].append(base + row);
+    }
+    load.table.indexedRows = load.table.rowCount();
+    load.st = result.st;
+}
+
+// Decode one record of a binary log into table, just as feedLine would the
+// lines it holds.
+static void feedRecord(ParseState &st, const void *rec, LogTable &table)
+{
+    taslog_rechdr_t hdr;
+    std::memcpy(&hdr, rec, sizeof(hdr));
+    if (hdr.type == RecPrethink) {
+        const taslog_prethink_t &r = *(const taslog_prethink_t *)rec;
+        table.appendRow(r.frameno, 1 / r.frametime);
+        table.hp.last() = r.health;
+        table.ap.last() = r.armor;
+        return;
+    } else if (hdr.type == RecDamage) {
+        const taslog_damage_t &r = *(const taslog_damage_t *)rec;
+        table.damages[table.rowCount() - 1] =
+            qMakePair(r.damage, (unsigned int)r.bits);
+        return;
+    }
+
+    // Player movement before the first frame has nowhere to go.
+    if (!table.rowCount())
+        return;
+
+    if (hdr.type == RecPmovePre) {
+        const taslog_pmove_pre_t &r = *(const taslog_pmove_pre_t *)rec;
+        table.msec.last() = r.msec;
+        table.buttons.last() = r.buttons;
+        table.pitch.last() = r.pitch;
+        table.yaw.last() = r.yaw;
+        table.fmove.last() = r.fsu[0];
+        table.smove.last() = r.fsu[1];
+        table.umove.last() = r.fsu[2];
+        if (r.punchangle[0] || r.punchangle[1])
+            table.punchangles[table.rowCount() - 1] =
+                qMakePair(r.punchangle[0], r.punchangle[1]);
+        std::memcpy(st.basevel, r.basevel, sizeof(st.basevel));
+        if (st.basevel[2])
+            table.vbasevels[table.rowCount() - 1] = st.basevel[2];
+    } else if (hdr.type == RecPmovePost) {
+        const taslog_pmove_post_t &r = *(const taslog_pmove_post_t *)rec;
+        table.numtouch.last() = r.numtouch != 0;
+        table.ladder.last() = r.ladder != 0;
+        table.posx.last() = r.pos[0];
+        table.posy.last() = r.pos[1];
+        table.posz.last() = r.pos[2];
+        table.hspd.last() = hypotf(r.vel[0], r.vel[1]);
+        table.ang.last() = atan2f(r.vel[1], r.vel[0]) * M_RAD2DEG;
+        table.vspd.last() = r.vel[2];
+        table.dst.last() = duckState(r.induck, r.flags);
+        table.og.last() = r.onground != -1;
+        table.wlvl.last() = r.waterlevel;
+        if (st.basevel[0] || st.basevel[1]) {
+            float vel[2] = {r.vel[0] + st.basevel[0],
+                            r.vel[1] + st.basevel[1]};
+            table.hbasevels[table.rowCount() - 1] = qMakePair(
+                hypotf(vel[0], vel[1]), atan2f(vel[1], vel[0]) * M_RAD2DEG);
+        }
+    }
+}
+
+// Decode the records of a binary log in [begin, end) into table, starting
+// from st.  Returns the end of the last complete record, since the game may
+// still be writing the one after it.  A corrupt record stops decoding there
+// for good.
+static const char *parseRecords(const char *begin, const char *end,
+                                ParseState &st, LogTable &table)
+{
+    const char *p = begin;
+    if (!st.haveHeader) {
+        ptrdiff_t ret = st.reader.read_header(p, end);
+        if (ret <= 0)
+            return p;
+        st.haveHeader = true;
+        p += ret;
+    }
+
+    char rec[TASLOG_MAX_RECSIZE];
+    ptrdiff_t ret;
+    while (p < end && (ret = st.reader.read_record(p, end, rec)) > 0) {
+        feedRecord(st, rec, table);
+        p += ret;
+    }
+    return p;
+}
+
+// The records of a binary log can only be decoded in order, so the whole log
+// is loaded by one worker.  Decoding is cheap enough that this is still
+// faster than parsing the equivalent text on every core.
+static LogLoad loadRecords(const char *begin, const char *end)
+{
+    LogLoad load;
+    load.st.binary = true;
+    load.parsedSize = parseRecords(begin, end, load.st, load.table) - begin;
+    indexChanges(load.table);
+    return load;
+}
+
+void LogTable::appendRow(unsigned int frameNum, float frameRate)
+{
+    frameNums.append(frameNum);
+    buttons.append(0);
+    frate.append(frameRate);
+    hp.append(0);
+    ap.append(0);
+    hspd.append(0);
+    ang.append(0);
+    vspd.append(0);
+    yaw.append(0);
+    pitch.append(0);
+    posx.append(0);
+    posy.append(0);
+    posz.append(0);
+    fmove.append(0);
+    smove.append(0);
+    umove.append(0);
+    msec.append(0);
+    og.append(0);
+    dst.append(0);
+    wlvl.append(0);
+    ladder.append(0);
+    numtouch.append(0);
+    elapsed.append((elapsed.isEmpty() ? 0 : elapsed.last()) +
+                   1 / (double)frameRate);
+}
+
+void LogTable::append(const LogTable &other)
+{
+    int base = rowCount();
+    frameNums += other.frameNums;
+    buttons += other.buttons;
+    frate += other.frate;
+    hp += other.hp;
+    ap += other.ap;
+    hspd += other.hspd;
+    ang += other.ang;
+    vspd += other.vspd;
+    yaw += other.yaw;
+    pitch += other.pitch;
+    posx += other.posx;
+    posy += other.posy;
+    posz += other.posz;
+    fmove += other.fmove;
+    smove += other.smove;
+    umove += other.umove;
+    msec += other.msec;
+    og += other.og;
+    dst += other.dst;
+    wlvl += other.wlvl;
+    ladder += other.ladder;
+    numtouch += other.numtouch;
+
+    double offset = elapsed.isEmpty() ? 0 : elapsed.last();
+    elapsed.reserve(elapsed.length() + other.elapsed.length());
+    for (double t : other.elapsed)
+        elapsed.append(offset + t);
+
+    damages.append(other.damages, base);
+    punchangles.append(other.punchangles, base);
+    hbasevels.append(other.hbasevels, base);
+    vbasevels.append(other.vbasevels, base);
+    objmoves.append(other.objmoves, base);
+    extralines.append(other.extralines, base);
+    explddists.append(other.explddists, base);
+}
+
 LogTableModel::LogTableModel(QObject *parent)
-    : QAbstractTableModel(parent)
+    : QAbstractTableModel(parent), logData(nullptr), logSize(0),
+      parsedSize(0), loading(false), numRows(0)
 {
     italicFont.setItalic(true);
     boldFont.setBold(true);
+    connect(&loadWatcher, SIGNAL(progressValueChanged(int)), this,
+            SLOT(reportLoadProgress(int)));
+    connect(&loadWatcher, SIGNAL(finished()), this, SLOT(finishLoad()));
+}
+
+LogTableModel::~LogTableModel()
+{
+    cancelLoad();
 }
 
 int LogTableModel::columnCount(const QModelIndex &) const
@@ -65,7 +693,7 @@ int LogTableModel::columnCount(const QModelIndex &) const
 
 int LogTableModel::rowCount(const QModelIndex &) const
 {
-    return frameNums.length();
+    return numRows;
 }
 
 QVariant LogTableModel::data(const QModelIndex &index, int role) const
@@ -76,51 +704,53 @@ QVariant LogTableModel::data(const QModelIndex &index, int role) const
     int waterLevel;
     int moveVal;
 
+    int row = index.row();
+
     switch (role) {
     case Qt::DisplayRole:
         switch (index.column()) {
         case HEAD_FRATE:
-            return logTableData[index.row()].frate;
+            return table.frate[row];
         case HEAD_MSEC:
-            return logTableData[index.row()].msec;
+            return table.msec[row];
         case HEAD_HP:
-            return logTableData[index.row()].hp;
+            return table.hp[row];
         case HEAD_AP:
-            return logTableData[index.row()].ap;
+            return table.ap[row];
         case HEAD_YAW:
-            return logTableData[index.row()].yaw;
+            return table.yaw[row];
         case HEAD_PITCH:
-            return logTableData[index.row()].pitch;
+            return table.pitch[row];
         case HEAD_POSX:
-            return logTableData[index.row()].posx;
+            return table.posx[row];
         case HEAD_POSY:
-            return logTableData[index.row()].posy;
+            return table.posy[row];
         case HEAD_POSZ:
-            return logTableData[index.row()].posz;
+            return table.posz[row];
         case HEAD_HSPD:
-            if (hbasevels.contains(index.row()))
-                return '*' + QString::number(logTableData[index.row()].hspd);
+            if (table.hbasevels.contains(row))
+                return '*' + QString::number(table.hspd[row]);
             else
-                return logTableData[index.row()].hspd;
+                return table.hspd[row];
         case HEAD_ANG:
-            if (hbasevels.contains(index.row()))
-                return '*' + QString::number(logTableData[index.row()].ang);
+            if (table.hbasevels.contains(row))
+                return '*' + QString::number(table.ang[row]);
             else
-                return logTableData[index.row()].ang;
+                return table.ang[row];
         case HEAD_VSPD:
-            if (vbasevels.contains(index.row()))
-                return '*' + QString::number(logTableData[index.row()].vspd);
+            if (table.vbasevels.contains(row))
+                return '*' + QString::number(table.vspd[row]);
             else
-                return logTableData[index.row()].vspd;
+                return table.vspd[row];
         }
         return QVariant();
 
     case Qt::ForegroundRole:
         switch (index.column()) {
         case HEAD_HP:
-            return damages.contains(index.row()) ? brushWhite : brushRed;
+            return table.damages.contains(row) ? brushWhite : brushRed;
         case HEAD_AP:
-            return damages.contains(index.row()) ? brushWhite : brushBlue;
+            return table.damages.contains(row) ? brushWhite : brushBlue;
         case HEAD_FRATE:
         case HEAD_MSEC:
             return brushFrGray;
@@ -132,89 +762,87 @@ QVariant LogTableModel::data(const QModelIndex &index, int role) const
         case HEAD_HSPD:
         case HEAD_ANG:
         case HEAD_VSPD:
-            if (numtouches.contains(index.row()))
+            if (table.numtouch[row])
                 return brushLRed;
             break;
         case HEAD_DST:
-            duckState = logTableData[index.row()].dst;
+            duckState = table.dst[row];
             if (duckState == 2)
                 return brushBlack;
             else if (duckState == 1)
                 return brushDckGray;
             break;
         case HEAD_DUCK:
-            if (logTableData[index.row()].buttons & IN_DUCK)
+            if (table.buttons[row] & IN_DUCK)
                 return brushMagenta;
             break;
         case HEAD_JUMP:
-            if (logTableData[index.row()].buttons & IN_JUMP)
+            if (table.buttons[row] & IN_JUMP)
                 return brushCyan;
             break;
         case HEAD_USE:
-            if (logTableData[index.row()].buttons & IN_USE)
+            if (table.buttons[row] & IN_USE)
                 return brushYellow;
             break;
         case HEAD_ATTACK:
-            if (logTableData[index.row()].buttons & IN_ATTACK)
+            if (table.buttons[row] & IN_ATTACK)
                 return brushYellow;
             break;
         case HEAD_ATTACK2:
-            if (logTableData[index.row()].buttons & IN_ATTACK2)
+            if (table.buttons[row] & IN_ATTACK2)
                 return brushYellow;
             break;
         case HEAD_RELOAD:
-            if (logTableData[index.row()].buttons & IN_RELOAD)
+            if (table.buttons[row] & IN_RELOAD)
                 return brushYellow;
             break;
         case HEAD_FMOVE:
-            moveVal = logTableData[index.row()].fmove;
+            moveVal = table.fmove[row];
             if (moveVal > 0)
                 return brushMoveBlue;
             else if (moveVal < 0)
                 return brushMoveRed;
             break;
         case HEAD_SMOVE:
-            moveVal = logTableData[index.row()].smove;
+            moveVal = table.smove[row];
             if (moveVal > 0)
                 return brushMoveBlue;
             else if (moveVal < 0)
                 return brushMoveRed;
             break;
         case HEAD_UMOVE:
-            moveVal = logTableData[index.row()].umove;
+            moveVal = table.umove[row];
             if (moveVal > 0)
                 return brushMoveBlue;
             else if (moveVal < 0)
                 return brushMoveRed;
             break;
         case HEAD_PITCH:
-            if (punchangles.contains(index.row()) &&
-                punchangles[index.row()].first)
+            if (table.punchangles.value(row).first)
                 return brushLMagenta;
             break;
         case HEAD_YAW:
-            if (punchangles.contains(index.row()) &&
-                punchangles[index.row()].second)
+            if (table.punchangles.value(row).second)
                 return brushLMagenta;
             break;
         case HEAD_HP:
         case HEAD_AP:
-            if (damages.contains(index.row()))
+            if (table.damages.contains(row))
                 return brushRed;
             break;
         case HEAD_OG:
-            if (logTableData[index.row()].og)
+            if (table.og[row])
                 return brushOgGreen;
             break;
         case HEAD_WLVL:
-            waterLevel = logTableData[index.row()].wlvl;
+            waterLevel = table.wlvl[row];
             if (waterLevel >= 2)
                 return brushBlue;
             else if (waterLevel == 1)
                 return brushDimBlue;
             break;
         case HEAD_LADDER:
-            if (logTableData[index.row()].ladder)
+            if (table.ladder[row])
                 return brushBrown;
         }
         break;
@@ -223,7 +851,7 @@ QVariant LogTableModel::data(const QModelIndex &index, int role) const
         switch (index.column()) {
         case HEAD_HSPD:
         case HEAD_ANG:
-            if (objmoves.contains(index.row()))
+            if (table.objmoves.contains(row))
                 return boldFont;
             break;
         case HEAD_FMOVE:
@@ -232,7 +860,7 @@ QVariant LogTableModel::data(const QModelIndex &index, int role) const
             return boldFont;
         case HEAD_HP:
         case HEAD_AP:
-            if (damages.contains(index.row()))
+            if (table.damages.contains(row))
                 return boldFont;
             break;
         }
@@ -242,17 +870,17 @@ QVariant LogTableModel::data(const QModelIndex &index, int role) const
         switch (index.column()) {
         case HEAD_HSPD:
         case HEAD_ANG:
-            if (hbasevels.contains(index.row())) {
-                auto entry = hbasevels[index.row()];
+            if (table.hbasevels.contains(row)) {
+                auto hbasevel = table.hbasevels.value(row);
                 basevelStr = QString("(with basevel) hspd = %1, ang = %2")
-                    .arg(entry.first).arg(entry.second);
+                    .arg(hbasevel.first).arg(hbasevel.second);
             }
-            if (objmoves.contains(index.row())) {
-                auto entry = objmoves[index.row()];
+            if (table.objmoves.contains(row)) {
+                auto objmove = table.objmoves.value(row);
                 objmoveStr = QString("push = %1, objhspd = %2, objang = %3")
-                    .arg(std::get<0>(entry) ? "yes" : "no")
-                    .arg(hypotf(std::get<1>(entry), std::get<2>(entry)))
-                    .arg(atan2f(std::get<2>(entry), std::get<1>(entry))
+                    .arg(std::get<0>(objmove) ? "yes" : "no")
+                    .arg(hypotf(std::get<1>(objmove), std::get<2>(objmove)))
+                    .arg(atan2f(std::get<2>(objmove), std::get<1>(objmove))
                          * M_RAD2DEG);
             }
             if (!basevelStr.isNull() && objmoveStr.isNull())
@@ -263,36 +891,36 @@ QVariant LogTableModel::data(const QModelIndex &index, int role) const
                 return basevelStr + QString(" | ") + objmoveStr;
             break;
         case HEAD_VSPD:
-            if (vbasevels.contains(index.row()))
+            if (table.vbasevels.contains(row))
                 return QString("vertical basevel = %1")
-                    .arg(vbasevels[index.row()]);
+                    .arg(table.vbasevels.value(row));
             break;
         case HEAD_PITCH:
-            if (punchangles.contains(index.row()))
+            if (table.punchangles.contains(row))
                 return QString("punchpitch = %1")
-                    .arg(punchangles[index.row()].first);
+                    .arg(table.punchangles.value(row).first);
             break;
         case HEAD_YAW:
-            if (punchangles.contains(index.row()))
+            if (table.punchangles.contains(row))
                 return QString("punchyaw = %1")
-                    .arg(punchangles[index.row()].second);
+                    .arg(table.punchangles.value(row).second);
             break;
         case HEAD_HP:
         case HEAD_AP:
-            if (damages.contains(index.row())) {
-                auto entry = damages[index.row()];
+            if (table.damages.contains(row)) {
+                auto damage = table.damages.value(row);
                 QString blastDistStr;
                 QStringList dmgStrList;
                 for (int flag : DMG_STRING.uniqueKeys()) {
-                    if (entry.second & flag)
+                    if (damage.second & flag)
                         dmgStrList.append(DMG_STRING[flag]);
                 }
                 if (dmgStrList.isEmpty())
-                    dmgStrList.append(entry.second ? "other" : "generic");
-                else if (entry.second & (1 << 6))
+                    dmgStrList.append(damage.second ? "other" : "generic");
+                else if (damage.second & (1 << 6))
                     blastDistStr = QString(" dist = %1")
-                        .arg(explddists[index.row()]);
-                return QString("damage = %1 (%2)%3").arg(entry.first)
+                        .arg(table.explddists.value(row));
+                return QString("damage = %1 (%2)%3").arg(damage.first)
                     .arg(dmgStrList.join(", ")).arg(blastDistStr);
             }
             break;
@@ -306,346 +934,235 @@ QVariant LogTableModel::data(const QModelIndex &index, int role) const
 QVariant LogTableModel::headerData(int section, Qt::Orientation orientation,
                                    int role) const
 {
-    if (role == Qt::FontRole && orientation == Qt::Vertical) {
-        if (extralines.contains(section))
-            return boldFont;
-        else
-            return italicFont;
+    if (orientation == Qt::Horizontal) {
+        if (role == Qt::DisplayRole)
+            return HEAD_LABELS[section];
+        return QVariant();
     }
 
+    if (role != Qt::FontRole && role != Qt::DisplayRole &&
+        role != Qt::UserRole)
+        return QVariant();
+
+    bool hasExtra = table.extralines.contains(section);
+
+    if (role == Qt::FontRole)
+        return hasExtra ? boldFont : italicFont;
+
     if (role == Qt::DisplayRole) {
-        if (orientation == Qt::Vertical) {
-            if (extralines.contains(section))
-                return '*' + QString::number(frameNums[section]);
-            else
-                return frameNums[section];
-        } else {
-            return HEAD_LABELS[section];
-        }
+        if (hasExtra)
+            return '*' + QString::number(table.frameNums[section]);
+        else
+            return table.frameNums[section];
     }
 
-    if (role == Qt::UserRole && orientation == Qt::Vertical &&
-        extralines.contains(section)) {
-        return extralines[section].join('\n');
-    }
+    if (hasExtra)
+        return table.extralines.value(section).join('\n');
 
     return QVariant();
 }
 
 bool LogTableModel::parseLogFile(const QString &logFileName)
 {
-#define STARTTOK(n) tok = strtok_r(lineptr + (n), " ", &saveptr);
-#define NEXTTOK tok = strtok_r(NULL, " ", &saveptr);
+    logFile.setFileName(logFileName);
+    if (!logFile.open(QIODevice::ReadOnly))
+        return false;
 
-    FILE *logFile = std::fopen(logFileName.toUtf8().data(), "r");
-    if (!logFile)
+    if (!mapLogFile()) {
+        logFile.close();
         return false;
+    }
 
-    float basevel[3] = {0, 0, 0};
-    int readState = 0;
-    LogEntry logEntry;
-    size_t n = 1024;
-    char *lineptr = (char *)std::malloc(n);
-
-    while (getline(&lineptr, &n, logFile) != -1) {
-        char *saveptr;
-        char *tok;
-
-        switch (readState) {
-        case 0:
-            if (strncmp(lineptr, "prethink", 8) == 0) {
-                STARTTOK(8);
-                frameNums.append(std::atoi(tok));
-                logTableData.append(logEntry);
-                NEXTTOK;
-                logTableData.last().frate = 1 / std::atof(tok);
-                readState = 1;
-                continue;
-            } else if (strncmp(lineptr, "dmg", 3) == 0) {
-                STARTTOK(3);
-                float dmg = std::atof(tok);
-                NEXTTOK;
-                unsigned long bits = std::strtoul(tok, NULL, 10);
-                damages[frameNums.length() - 1] = qMakePair(dmg, bits);
-                continue;
-            } else if (strncmp(lineptr, "obj", 3) == 0) {
-                STARTTOK(3);
-                bool push = *tok != '0';
-                NEXTTOK;
-                float velx = std::atof(tok);
-                NEXTTOK;
-                float vely = std::atof(tok);
-                objmoves[frameNums.length() - 1] =
-                    std::make_tuple(push, velx, vely);
-                continue;
-            } else if (strncmp(lineptr, "expld", 5) == 0) {
-                float start[3];
-                STARTTOK(5);
-                start[0] = std::atof(tok);
-                NEXTTOK;
-                start[1] = std::atof(tok);
-                NEXTTOK;
-                start[2] = std::atof(tok);
-
-                float end[3];
-                NEXTTOK;
-                NEXTTOK;
-                NEXTTOK;
-                NEXTTOK;
-                end[0] = std::atof(tok);
-                NEXTTOK;
-                end[1] = std::atof(tok);
-                NEXTTOK;
-                end[2] = std::atof(tok);
-
-                float disp[3] = {end[0] - start[0], end[1] - start[1],
-                                 end[2] - start[2]};
-                explddists[frameNums.length() - 1] = sqrt(
-                    disp[0] * disp[0] + disp[1] * disp[1] + disp[2] * disp[2]);
-                continue;
-            }
-            break;
-        case 1:
-            if (strncmp(lineptr, "health", 6) != 0)
-                break;
-            STARTTOK(6);
-            logTableData.last().hp = std::atof(tok);
-            NEXTTOK;
-            logTableData.last().ap = std::atof(tok);
-            readState = 2;
-            continue;
-        case 2:
-            if (strncmp(lineptr, "usercmd", 7) != 0)
-                break;
-            STARTTOK(7);
-            logTableData.last().msec = std::atoi(tok);
-            NEXTTOK;
-            logTableData.last().buttons = std::strtoul(tok, NULL, 10);
-            NEXTTOK;
-            logTableData.last().pitch = std::atof(tok);
-            NEXTTOK;
-            logTableData.last().yaw = std::atof(tok);
-            readState = 3;
-            continue;
-        case 3:
-            if (strncmp(lineptr, "fsu", 3) != 0)
-                break;
-            STARTTOK(3);
-            logTableData.last().fmove = std::atoi(tok);
-            NEXTTOK;
-            logTableData.last().smove = std::atoi(tok);
-            NEXTTOK;
-            logTableData.last().umove = std::atoi(tok);
-            readState = 4;
-            continue;
-        case 4:
-            if (strncmp(lineptr, "fg", 2) != 0)
-                break;
-            readState = 5;
-            continue;
-        case 5: {
-            if (strncmp(lineptr, "pa", 2) != 0)
-                break;
-            float tmppangs[2];
-            STARTTOK(2);
-            tmppangs[0] = std::atof(tok);
-            NEXTTOK;
-            tmppangs[1] = std::atof(tok);
-            if (tmppangs[0] || tmppangs[1])
-                punchangles[frameNums.length() - 1] =
-                    qMakePair(tmppangs[0], tmppangs[1]);
-            readState = 6;
-            continue;
-        }
-        case 6:
-            if (strncmp(lineptr, "pmove", 5) != 0)
-                break;
-            STARTTOK(5);
-            if (*tok != '1')
-                break;
-            NEXTTOK;
-            NEXTTOK;
-            NEXTTOK;
-            NEXTTOK;
-            basevel[0] = std::atof(tok);
-            NEXTTOK;
-            basevel[1] = std::atof(tok);
-            NEXTTOK;
-            basevel[2] = std::atof(tok);
-            if (basevel[2])
-                vbasevels[frameNums.length() - 1] = basevel[2];
-            readState = 7;
-            continue;
-        case 7:
-            if (strncmp(lineptr, "ntl", 3) != 0)
-                break;
-            STARTTOK(3);
-            if (*tok != '0')
-                numtouches.insert(frameNums.length() - 1);
-            NEXTTOK;
-            logTableData.last().ladder = *tok != '0';
-            readState = 8;
-            continue;
-        case 8:
-            if (strncmp(lineptr, "pos", 3) != 0)
-                break;
-            STARTTOK(3);
-            if (*tok != '2')
-                break;
-            NEXTTOK;
-            logTableData.last().posx = std::atof(tok);
-            NEXTTOK;
-            logTableData.last().posy = std::atof(tok);
-            NEXTTOK;
-            logTableData.last().posz = std::atof(tok);
-            readState = 9;
-            continue;
-        case 9: {
-            if (strncmp(lineptr, "pmove", 5) != 0)
-                break;
-            STARTTOK(5);
-            if (*tok != '2')
-                break;
+    loading = true;
+    if (logSize >= (qint64)sizeof(TASLOG_MAGIC) &&
+        std::memcmp(logData, TASLOG_MAGIC, sizeof(TASLOG_MAGIC)) == 0) {
+        loadWatcher.setFuture(QtConcurrent::run(loadRecords, logData,
+                                                logData + logSize));
+        return true;
+    }
 
-            float vel[3];
-            NEXTTOK;
-            vel[0] = std::atof(tok);
-            NEXTTOK;
-            vel[1] = std::atof(tok);
-            NEXTTOK;
-            vel[2] = std::atof(tok);
-            logTableData.last().hspd = hypotf(vel[0], vel[1]);
-            logTableData.last().ang = atan2f(vel[1], vel[0]) *
-                M_RAD2DEG;
-            logTableData.last().vspd = vel[2];
+    const char *end = completeLinesEnd(logData, logData + logSize);
+    parsedSize = end - logData;
+    loadWatcher.setFuture(QtConcurrent::mappedReduced(
+        splitLog(logData, end), parseChunk, mergeChunk,
+        QtConcurrent::OrderedReduce | QtConcurrent::SequentialReduce));
 
-            NEXTTOK;
-            NEXTTOK;
-            NEXTTOK;
-            NEXTTOK;
-            bool bInDuck = *tok != '0';
-            NEXTTOK;
-            bool ducking = std::strtoul(tok, NULL, 10) & FL_DUCKING;
-            if (ducking)
-                logTableData.last().dst = 2;
-            else if (bInDuck)
-                logTableData.last().dst = 1;
-            else
-                logTableData.last().dst = 0;
+    return true;
+}
 
-            NEXTTOK;
-            logTableData.last().og = std::atoi(tok) != -1;
-            NEXTTOK;
-            logTableData.last().wlvl = std::atoi(tok);
-            if (basevel[0] || basevel[1]) {
-                vel[0] += basevel[0];
-                vel[1] += basevel[1];
-                hbasevels[frameNums.length() - 1] = qMakePair(
-                    hypotf(vel[0], vel[1]),
-                    atan2f(vel[1], vel[0]) * M_RAD2DEG);
-            }
-            readState = 0;
-            continue;
-        }
-        }
+void LogTableModel::reportLoadProgress(int done)
+{
+    emit loadProgress(done, loadWatcher.progressMaximum());
+}
 
-        if (strncmp(lineptr, "pos", 3) == 0 ||
-            strncmp(lineptr, "cl_yawspeed", 11) == 0 ||
-            strncmp(lineptr, "execing", 7) == 0)
-            continue;
+void LogTableModel::finishLoad()
+{
+    if (!loading || loadWatcher.isCanceled())
+        return;
+    loading = false;
 
-        extralines[frameNums.length() - 1].append(lineptr);
-    }
+    LogLoad load = loadWatcher.result();
+    foldPreamble(load.table);
+    parseState = load.st;
+    if (parseState.binary)
+        parsedSize = load.parsedSize;
+
+    int rows = load.table.rowCount();
+    if (rows)
+        beginInsertRows(QModelIndex(), 0, rows - 1);
+    table = load.table;
+    numRows = rows;
+    if (rows)
+        endInsertRows();
+
+    emit loadFinished();
+}
 
-    std::free(lineptr);
-    std::fclose(logFile);
+void LogTableModel::cancelLoad()
+{
+    // The workers read straight from the mapping, so they have to be gone
+    // before it is unmapped.
+    loading = false;
+    loadWatcher.cancel();
+    loadWatcher.waitForFinished();
+}
+
+// Pick up whatever has been appended to the log since it was last parsed.
+// Returns false if the file has been truncated or replaced, in which case it
+// has to be parsed again from scratch.
+bool LogTableModel::appendLogFile()
+{
+    // Anything new is picked up once the load finishes.
+    if (loading)
+        return true;
 
-    if (extralines.contains(-1)){
-        extralines[-1].append(extralines.value(0, QStringList()));
-        extralines[0].swap(extralines[-1]);
-        extralines.remove(-1);
+    struct stat diskStat, openStat;
+    if (!logFile.isOpen() ||
+        stat(logFile.fileName().toUtf8().data(), &diskStat) ||
+        fstat(logFile.handle(), &openStat) ||
+        diskStat.st_ino != openStat.st_ino || openStat.st_size < logSize)
+        return false;
+    if (openStat.st_size == logSize)
+        return true;
+
+    if (!mapLogFile())
+        return false;
+
+    // Rows are added to table first and only become visible through numRows
+    // once the view has been told about them.
+    const char *end;
+    if (parseState.binary) {
+        end = parseRecords(logData + parsedSize, logData + logSize,
+                           parseState, table);
+    } else {
+        end = completeLinesEnd(logData + parsedSize, logData + logSize);
+        parseLines(logData + parsedSize, end, parseState, table);
     }
+    indexChanges(table);
+    parsedSize = end - logData;
+    foldPreamble(table);
 
-    beginInsertRows(QModelIndex(), 0, frameNums.length() - 1);
-    endInsertRows();
+    int oldRows = numRows;
+    int newRows = table.rowCount();
+    if (newRows > oldRows) {
+        beginInsertRows(QModelIndex(), oldRows, newRows - 1);
+        numRows = newRows;
+        endInsertRows();
+    }
+
+    // The last row may have picked up more lines.
+    if (oldRows) {
+        emit dataChanged(index(oldRows - 1, 0),
+                         index(oldRows - 1, HEAD_LENGTH - 1));
+        emit headerDataChanged(Qt::Vertical, oldRows - 1, oldRows - 1);
+    }
 
     return true;
 }
 
+bool LogTableModel::mapLogFile()
+{
+    if (logData)
+        logFile.unmap((uchar *)logData);
+    logData = nullptr;
+    logSize = logFile.size();
+    if (!logSize)
+        return true;
+    logData = (const char *)logFile.map(0, logSize);
+    if (!logData)
+        logSize = 0;
+    return logData;
+}
+
 void LogTableModel::clearAllRows()
 {
-    beginRemoveRows(QModelIndex(), 0, frameNums.length() - 1);
-    logTableData.clear();
-    frameNums.clear();
-    damages.clear();
-    punchangles.clear();
-    hbasevels.clear();
-    vbasevels.clear();
-    objmoves.clear();
-    numtouches.clear();
-    extralines.clear();
+    cancelLoad();
+    beginRemoveRows(QModelIndex(), 0, numRows - 1);
+    table = LogTable();
+    parseState = ParseState();
+    numRows = 0;
+    parsedSize = 0;
+    if (logData)
+        logFile.unmap((uchar *)logData);
+    logData = nullptr;
+    logSize = 0;
+    logFile.close();
     endRemoveRows();
 }
 
 QModelIndex LogTableModel::findDiff(const QModelIndex &curIndex,
                                     bool forward) const
 {
-#define SEARCHDIFF(field)                                               \
-    {                                                                   \
-        auto curVal = logTableData[curIndex.row()].field;               \
-        if (forward) {                                                  \
-            for (int row = curIndex.row() + 1;                          \
-                 row < logTableData.length(); row++) {                  \
-                if ((logTableData[row].field) != curVal)                \
-                    return createIndex(row, curIndex.column());         \
-            }                                                           \
-        } else {                                                        \
-            for (int row = curIndex.row() - 1; row >= 0; row--) {       \
-                if ((logTableData[row].field) != curVal)                \
-                    return createIndex(row, curIndex.column());         \
-            }                                                           \
-        }                                                               \
-    }
+    if (!curIndex.isValid() || !numRows)
+        return QModelIndex();
 
-    if (!curIndex.isValid())
+    int row = findChange(table.changes[curIndex.column()], curIndex.row(),
+                         forward);
+    if (row == -1)
         return QModelIndex();
+    return createIndex(row, curIndex.column());
+}
 
-    switch (curIndex.column()) {
-    case HEAD_FRATE: SEARCHDIFF(frate); break;
-    case HEAD_MSEC: SEARCHDIFF(msec); break;
-    case HEAD_HP: SEARCHDIFF(hp); break;
-    case HEAD_AP: SEARCHDIFF(ap); break;
-    case HEAD_HSPD: SEARCHDIFF(hspd); break;
-    case HEAD_ANG: SEARCHDIFF(ang); break;
-    case HEAD_VSPD: SEARCHDIFF(vspd); break;
-    case HEAD_OG: SEARCHDIFF(og); break;
-    case HEAD_DST: SEARCHDIFF(dst); break;
-    case HEAD_DUCK: SEARCHDIFF(buttons & IN_DUCK); break;
-    case HEAD_JUMP: SEARCHDIFF(buttons & IN_JUMP); break;
-    case HEAD_FMOVE: SEARCHDIFF(fmove); break;
-    case HEAD_SMOVE: SEARCHDIFF(smove); break;
-    case HEAD_UMOVE: SEARCHDIFF(umove); break;
-    case HEAD_YAW: SEARCHDIFF(yaw); break;
-    case HEAD_PITCH: SEARCHDIFF(pitch); break;
-    case HEAD_USE: SEARCHDIFF(buttons & IN_USE); break;
-    case HEAD_ATTACK: SEARCHDIFF(buttons & IN_ATTACK); break;
-    case HEAD_ATTACK2: SEARCHDIFF(buttons & IN_ATTACK2); break;
-    case HEAD_RELOAD: SEARCHDIFF(buttons & IN_RELOAD); break;
-    case HEAD_WLVL: SEARCHDIFF(wlvl); break;
-    case HEAD_LADDER: SEARCHDIFF(ladder); break;
-    case HEAD_POSX: SEARCHDIFF(posx); break;
-    case HEAD_POSY: SEARCHDIFF(posy); break;
-    case HEAD_POSZ: SEARCHDIFF(posz); break;
+// Without a current index, searching forward starts from the top.
+QModelIndex LogTableModel::findEvent(const QModelIndex &curIndex,
+                                     FrameEvent event, bool forward) const
+{
+    if (!numRows)
+        return QModelIndex();
+
+    int curRow = curIndex.isValid() ? curIndex.row() : -1;
+    int row = -1;
+    int column = HEAD_HP;
+    switch (event) {
+    case EVENT_DAMAGE:
+        if (forward)
+            row = table.damages.nextRow(curRow);
+        else
+            row = table.damages.prevRow(curRow);
+        break;
+    case EVENT_GROUND:
+        row = findChange(table.changes[HEAD_OG], curRow, forward);
+        column = HEAD_OG;
+        break;
+    case EVENT_NUMTOUCH:
+        // If the neighbouring row has not touched anything, the next change
+        // is where it does.
+        row = curRow + (forward ? 1 : -1);
+        if (row < 0 || row >= numRows)
+            row = -1;
+        else if (!table.numtouch[row])
+            row = findChange(table.changes[CHANGES_NUMTOUCH], row, forward);
+        column = HEAD_HSPD;
+        break;
     }
 
-    return QModelIndex();
+    if (row == -1 || row >= numRows)
+        return QModelIndex();
+    return createIndex(row, curIndex.isValid() ? curIndex.column() : column);
 }
 
 float LogTableModel::sumDuration(int startRow, int endRow) const
 {
-    double duration = 0;
-    for (int i = startRow; i <= endRow; i++) {
-        duration += 1 / (double)logTableData[i].frate;
-    }
-    return duration;
+    double start = startRow ? table.elapsed[startRow - 1] : 0;
+    return table.elapsed[endRow] - start;
 }
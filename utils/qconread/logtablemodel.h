@@ -2,37 +2,122 @@
 #define LOGTABLEMODEL_H
 
 #include <QAbstractTableModel>
+#include <QFile>
 #include <QFont>
-#include <QSet>
+#include <QFutureWatcher>
+#include <QPair>
+#include <QStringList>
+#include <QVector>
+#include <algorithm>
 #include <tuple>
+#include "taslogcodec.hpp"
 
-struct LogEntry
+// The readState machine, kept between calls so that parsing can resume in
+// the middle of a frame.
+struct ParseState
 {
-    unsigned int buttons;
-    float frate;
-    float hp;
-    float ap;
-    float hspd;
-    float ang;
-    float vspd;
-    float yaw;
-    float pitch;
-    float posx;
-    float posy;
-    float posz;
-    short fmove;
-    short smove;
-    short umove;
-    char msec;
-    char og;
-    char dst;
-    char wlvl;
-    char ladder;
+    int readState = 0;
+    float basevel[3] = {0, 0, 0};
+    // Binary logs written with sv_taslog 2 go through reader instead.
+    bool binary = false;
+    bool haveHeader = false;
+    taslog_reader_t reader;
+};
+
+// Values attached to only some of the rows, kept sorted by row.  Row -1
+// holds whatever came before the first prethink line.
+template<typename T>
+class SparseColumn
+{
+public:
+    bool contains(int row) const { return find(row) != -1; }
+    T value(int row) const;
+    // Cheap as long as rows are added in increasing order, which is how the
+    // log is parsed.
+    T &operator[](int row);
+    void remove(int row);
+    void append(const SparseColumn &other, int base);
+    // The nearest row after or before row that has a value, or -1.
+    int nextRow(int row) const;
+    int prevRow(int row) const;
+
+private:
+    int find(int row) const;
+
+    QVector<int> rows;
+    QVector<T> values;
+};
+
+// The parsed log, with one contiguous array per column.
+struct LogTable
+{
+    QVector<unsigned int> frameNums;
+    QVector<unsigned int> buttons;
+    QVector<float> frate;
+    QVector<float> hp;
+    QVector<float> ap;
+    QVector<float> hspd;
+    QVector<float> ang;
+    QVector<float> vspd;
+    QVector<float> yaw;
+    QVector<float> pitch;
+    QVector<float> posx;
+    QVector<float> posy;
+    QVector<float> posz;
+    QVector<short> fmove;
+    QVector<short> smove;
+    QVector<short> umove;
+    QVector<char> msec;
+    QVector<char> og;
+    QVector<char> dst;
+    QVector<char> wlvl;
+    QVector<char> ladder;
+    QVector<char> numtouch;
+    // Time from the start of the log to the end of each row, so that the
+    // duration of any range of rows is a subtraction.
+    QVector<double> elapsed;
+
+    // For each column, the rows whose value differs from the row before, in
+    // increasing order.  Rows past indexedRows have not been looked at yet.
+    QVector<QVector<int>> changes;
+    int indexedRows = 0;
+
+    SparseColumn<QPair<float, unsigned int>> damages;
+    SparseColumn<QPair<float, float>> punchangles;
+    SparseColumn<QPair<float, float>> hbasevels;
+    SparseColumn<float> vbasevels;
+    SparseColumn<std::tuple<bool, float, float>> objmoves;
+    SparseColumn<QStringList> extralines;
+    SparseColumn<float> explddists;
+
+    int rowCount() const { return frameNums.length(); }
+    void appendRow(unsigned int frameNum, float frameRate);
+    // Append rows parsed separately, renumbering them to follow ours.  The
+    // change lists are left alone.
+    void append(const LogTable &other);
+};
+
+struct LogLoad
+{
+    LogTable table;
+    ParseState st;
+    // The bytes of a binary log decoded, which stop at the last complete
+    // record.
+    qint64 parsedSize = 0;
 };
 
 class LogTableModel : public QAbstractTableModel
 {
+    Q_OBJECT
+
 public:
+    enum FrameEvent
+    {
+        EVENT_DAMAGE,
+        EVENT_GROUND,
+        EVENT_NUMTOUCH,
+    };
+
     // IMPORTANT: Make sure the labels in HEAD_LABELS matches that of
     // HeaderIndex.  If you modify HeaderIndex, remember to modify HEAD_LABELS
     // and vice versa!
@@ -74,29 +159,112 @@ public:
     };
 
     LogTableModel(QObject *parent);
+    ~LogTableModel();
     int columnCount(const QModelIndex &parent) const;
     int rowCount(const QModelIndex &parent) const;
     QVariant data(const QModelIndex &index, int role) const;
     QVariant headerData(int section, Qt::Orientation orientation,
                         int role) const;
     bool parseLogFile(const QString &logFileName);
+    bool appendLogFile();
     void clearAllRows();
     QModelIndex findDiff(const QModelIndex &curIndex, bool forward) const;
+    QModelIndex findEvent(const QModelIndex &curIndex, FrameEvent event,
+                          bool forward) const;
     float sumDuration(int startRow, int endRow) const;
 
+signals:
+    void loadProgress(int done, int total);
+    void loadFinished();
+
+private slots:
+    void reportLoadProgress(int done);
+    void finishLoad();
+
 private:
-    QVector<LogEntry> logTableData;
-    QVector<unsigned int> frameNums;
-    QHash<unsigned int, QPair<float, unsigned int>> damages;
-    QHash<unsigned int, QPair<float, float>> punchangles;
-    QHash<unsigned int, QPair<float, float>> hbasevels;
-    QHash<unsigned int, float> vbasevels;
-    QHash<unsigned int, std::tuple<bool, float, float>> objmoves;
-    QHash<unsigned int, QStringList> extralines;
-    QHash<unsigned int, float> explddists;
-    QSet<unsigned int> numtouches;
+    bool mapLogFile();
+    void cancelLoad();
+
+    // The log is mapped rather than read, and split into chunks which are
+    // parsed on the global thread pool.  Once loaded, new lines are parsed
+    // straight into table with parseState carried over.
+    QFile logFile;
+    const char *logData;
+    qint64 logSize;
+    qint64 parsedSize;
+    bool loading;
+    QFutureWatcher<LogLoad> loadWatcher;
+    LogTable table;
+    ParseState parseState;
+    int numRows;
     QFont italicFont;
     QFont boldFont;
 };
 
+template<typename T>
+int SparseColumn<T>::find(int row) const
+{
+    auto it = std::lower_bound(rows.constBegin(), rows.constEnd(), row);
+    if (it == rows.constEnd() || *it != row)
+        return -1;
+    return it - rows.constBegin();
+}
+
+template<typename T>
+T SparseColumn<T>::value(int row) const
+{
+    int i = find(row);
+    return i == -1 ? T() : values[i];
+}
+
+template<typename T>
+T &SparseColumn<T>::operator[](int row)
+{
+    if (rows.isEmpty() || rows.last() < row) {
+        rows.append(row);
+        values.append(T());
+        return values.last();
+    }
+
+    auto it = std::lower_bound(rows.begin(), rows.end(), row);
+    int i = it - rows.begin();
+    if (*it != row) {
+        rows.insert(i, row);
+        values.insert(i, T());
+    }
+    return values[i];
+}
+
+template<typename T>
+void SparseColumn<T>::remove(int row)
+{
+    int i = find(row);
+    if (i == -1)
+        return;
+    rows.remove(i);
+    values.remove(i);
+}
+
+template<typename T>
+void SparseColumn<T>::append(const SparseColumn &other, int base)
+{
+    for (int row : other.rows)
+        rows.append(base + row);
+    values += other.values;
+}
+
+template<typename T>
+int SparseColumn<T>::nextRow(int row) const
+{
+    auto it = std::upper_bound(rows.constBegin(), rows.constEnd(), row);
+    return it == rows.constEnd() ? -1 : *it;
+}
+
+template<typename T>
+int SparseColumn<T>::prevRow(int row) const
+{
+    auto it = std::lower_bound(rows.constBegin(), rows.constEnd(), row);
+    return it == rows.constBegin() ? -1 : *(it - 1);
+}
+
 #endif
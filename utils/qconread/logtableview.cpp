@@ -54,24 +54,35 @@ void LogTableView::setIndexToDiff(bool forward)
         setCurrentIndex(newIndex);
 }
 
+void LogTableView::setIndexToEvent(LogTableModel::FrameEvent event,
+                                   bool forward)
+{
+    QModelIndex newIndex = model()->findEvent(currentIndex(), event, forward);
+    if (newIndex.isValid())
+        setCurrentIndex(newIndex);
+}
+
 void LogTableView::selectionChanged(const QItemSelection &selected,
                                     const QItemSelection &deselected)
 {
     QTableView::selectionChanged(selected, deselected);
 
-    QModelIndexList indexList = selectedIndexes();
-    if (indexList.empty()) {
+    // Only the first and last selected rows matter, and a selection made by
+    // dragging or shift-clicking is a single range however many cells it
+    // covers, so look at the ranges rather than every selected index.
+    QItemSelection selection = selectionModel()->selection();
+    if (selection.isEmpty()) {
         emit(showNumFrames(0, 0));
         return;
     }
 
-    int min = indexList[0].row();
-    int max = indexList[0].row();
-    for (int i = 1; i < indexList.size(); i++) {
-        if (indexList[i].row() < min)
-            min = indexList[i].row();
-        else if (indexList[i].row() > max)
-            max = indexList[i].row();
+    int min = selection[0].top();
+    int max = selection[0].bottom();
+    for (const QItemSelectionRange &range : selection) {
+        if (range.top() < min)
+            min = range.top();
+        if (range.bottom() > max)
+            max = range.bottom();
     }
 
     emit(showNumFrames(max - min + 1, model()->sumDuration(min, max)));
@@ -13,6 +13,7 @@ public:
     void setModel(LogTableModel *model);
     LogTableModel *model() const;
     void setIndexToDiff(bool forward);
+    void setIndexToEvent(LogTableModel::FrameEvent event, bool forward);
 
 signals:
     void showNumFrames(int, float);
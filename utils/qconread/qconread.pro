@@ -4,10 +4,12 @@
 
 TEMPLATE = app
 TARGET = qconread
-INCLUDEPATH += .
+INCLUDEPATH += . ../../injectlib
 CONFIG += c++11
-QT += widgets
+QT += widgets concurrent
 
 # Input
-HEADERS += qcreadwin.h logtableview.h logtablemodel.h
-SOURCES += qcreadwin.cpp logtableview.cpp logtablemodel.cpp main.cpp
+HEADERS += qcreadwin.h logtableview.h logtablemodel.h \
+    ../../injectlib/taslog.hpp ../../injectlib/taslogcodec.hpp
+SOURCES += qcreadwin.cpp logtableview.cpp logtablemodel.cpp main.cpp \
+    ../../injectlib/taslogcodec.cpp
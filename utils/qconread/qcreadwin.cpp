@@ -1,20 +1,31 @@
 #include <QFileDialog>
+#include <QFileInfo>
 #include <QMenuBar>
 #include <QMessageBox>
 #include <QStatusBar>
 #include <QHeaderView>
+#include <QScrollBar>
 #include "qcreadwin.h"
 #include "logtablemodel.h"
 
 static const QString WIN_NAME = "Qconsole Reader";
 
+// The game writes to the log many times per frame, so changes are coalesced
+// before the new lines are read.
+static const int APPEND_DELAY_MS = 100;
+
 QCReadWin::QCReadWin()
 {
     resize(1000, 600);
     setWindowTitle(WIN_NAME);
 
     logTableView = new LogTableView(this);
-    logTableView->setModel(new LogTableModel(logTableView));
+    LogTableModel *logTableModel = new LogTableModel(logTableView);
+    logTableView->setModel(logTableModel);
+    connect(logTableModel, SIGNAL(loadProgress(int, int)), this,
+            SLOT(showLoadProgress(int, int)));
+    connect(logTableModel, SIGNAL(loadFinished()), this,
+            SLOT(logFileLoaded()));
     connect(logTableView->verticalHeader(), SIGNAL(sectionClicked(int)), this,
             SLOT(showExtraLines(int)));
     connect(logTableView, SIGNAL(showNumFrames(int, float)), this,
@@ -35,6 +46,10 @@ QCReadWin::QCReadWin()
                         QKeySequence("Ctrl+O"));
     menuFile->addAction("&Reload log", this, SLOT(reloadLogFile()),
                         QKeySequence("Ctrl+R"));
+    actFollow = menuFile->addAction("&Follow log", this,
+                                    SLOT(followLogFile(bool)),
+                                    QKeySequence("Ctrl+F"));
+    actFollow->setCheckable(true);
     menuFile->addAction("&Quit", this, SLOT(close()), QKeySequence("Ctrl+Q"));
 
     QMenu *menuView = menuBar()->addMenu("&View");
@@ -45,12 +60,36 @@ QCReadWin::QCReadWin()
                       QKeySequence("]"));
     menuGo->addAction("&Prev different", this, SLOT(findPrevDiff()),
                       QKeySequence("["));
+    menuGo->addSeparator();
+    menuGo->addAction("Next &damage", this, SLOT(findNextDamage()),
+                      QKeySequence("D"));
+    menuGo->addAction("Prev d&amage", this, SLOT(findPrevDamage()),
+                      QKeySequence("Shift+D"));
+    menuGo->addAction("Next &ground change", this, SLOT(findNextGround()),
+                      QKeySequence("G"));
+    menuGo->addAction("Prev g&round change", this, SLOT(findPrevGround()),
+                      QKeySequence("Shift+G"));
+    menuGo->addAction("Next &touch", this, SLOT(findNextTouch()),
+                      QKeySequence("T"));
+    menuGo->addAction("Prev t&ouch", this, SLOT(findPrevTouch()),
+                      QKeySequence("Shift+T"));
 
     QMenu *menuHelp = menuBar()->addMenu("&Help");
     menuHelp->addAction("&About...", this, SLOT(showAbout()));
 
     lblNumFrames = new QLabel(statusBar());
     statusBar()->addPermanentWidget(lblNumFrames);
+
+    logWatcher = new QFileSystemWatcher(this);
+    connect(logWatcher, SIGNAL(fileChanged(const QString &)), this,
+            SLOT(logFileChanged()));
+    connect(logWatcher, SIGNAL(directoryChanged(const QString &)), this,
+            SLOT(logFileChanged()));
+
+    appendTimer = new QTimer(this);
+    appendTimer->setSingleShot(true);
+    appendTimer->setInterval(APPEND_DELAY_MS);
+    connect(appendTimer, SIGNAL(timeout()), this, SLOT(appendLogFile()));
 }
 
 void QCReadWin::findNextDiff()
@@ -63,10 +102,40 @@ void QCReadWin::findPrevDiff()
     logTableView->setIndexToDiff(false);
 }
 
+void QCReadWin::findNextDamage()
+{
+    logTableView->setIndexToEvent(LogTableModel::EVENT_DAMAGE, true);
+}
+
+void QCReadWin::findPrevDamage()
+{
+    logTableView->setIndexToEvent(LogTableModel::EVENT_DAMAGE, false);
+}
+
+void QCReadWin::findNextGround()
+{
+    logTableView->setIndexToEvent(LogTableModel::EVENT_GROUND, true);
+}
+
+void QCReadWin::findPrevGround()
+{
+    logTableView->setIndexToEvent(LogTableModel::EVENT_GROUND, false);
+}
+
+void QCReadWin::findNextTouch()
+{
+    logTableView->setIndexToEvent(LogTableModel::EVENT_NUMTOUCH, true);
+}
+
+void QCReadWin::findPrevTouch()
+{
+    logTableView->setIndexToEvent(LogTableModel::EVENT_NUMTOUCH, false);
+}
+
 void QCReadWin::openLogFile()
 {
     logFileName = QFileDialog::getOpenFileName(
-        this, "Open Log", "", "Log files (*.log);;All files (*.*)");
+        this, "Open Log", "", "Log files (*.log *.taslog);;All files (*.*)");
     logTableView->setFocus(Qt::OtherFocusReason);
     reloadLogFile();
 }
@@ -79,6 +148,63 @@ void QCReadWin::reloadLogFile()
     extraLinesEdit->clear();
     if (!logTableView->model()->parseLogFile(logFileName))
         QMessageBox::warning(this, "Error", "Failed to parse.");
+    followLogFile(actFollow->isChecked());
+}
+
+void QCReadWin::followLogFile(bool follow)
+{
+    QStringList watched = logWatcher->files() + logWatcher->directories();
+    if (!watched.isEmpty())
+        logWatcher->removePaths(watched);
+    if (!follow || logFileName.isNull())
+        return;
+
+    // The directory is watched as well because the watcher stops following
+    // the file once it is removed, which taslaunch does before every run.
+    logWatcher->addPath(QFileInfo(logFileName).absolutePath());
+    if (QFile::exists(logFileName))
+        logWatcher->addPath(logFileName);
+}
+
+void QCReadWin::logFileChanged()
+{
+    if (!appendTimer->isActive())
+        appendTimer->start();
+}
+
+void QCReadWin::appendLogFile()
+{
+    if (!QFile::exists(logFileName))
+        return;
+
+    // Keep the newest rows in view if we were already at the bottom.
+    QScrollBar *vscroll = logTableView->verticalScrollBar();
+    bool atBottom = vscroll->value() == vscroll->maximum();
+
+    if (!logTableView->model()->appendLogFile()) {
+        // The game has started a new log, so read it from the beginning.
+        reloadLogFile();
+        return;
+    }
+
+    if (atBottom)
+        logTableView->scrollToBottom();
+}
+
+void QCReadWin::showLoadProgress(int done, int total)
+{
+    if (total)
+        statusBar()->showMessage(QString("Parsing log... %1%")
+                                 .arg(100 * done / total));
+}
+
+void QCReadWin::logFileLoaded()
+{
+    statusBar()->clearMessage();
+
+    // Lines written while the log was being parsed have not been read yet.
+    if (actFollow->isChecked())
+        appendLogFile();
 }
 
 void QCReadWin::showAbout()
@@ -2,9 +2,11 @@
 #define QCREADWIN_H
 
 #include <QDockWidget>
+#include <QFileSystemWatcher>
 #include <QMainWindow>
 #include <QPlainTextEdit>
 #include <QLabel>
+#include <QTimer>
 #include "logtableview.h"
 
 class QCReadWin : public QMainWindow
@@ -17,8 +19,19 @@ public:
 private slots:
     void findNextDiff();
     void findPrevDiff();
+    void findNextDamage();
+    void findPrevDamage();
+    void findNextGround();
+    void findPrevGround();
+    void findNextTouch();
+    void findPrevTouch();
     void openLogFile();
     void reloadLogFile();
+    void followLogFile(bool);
+    void logFileChanged();
+    void appendLogFile();
+    void showLoadProgress(int, int);
+    void logFileLoaded();
     void showAbout();
     void showExtraLines(int);
     void showNumFrames(int, float);
@@ -29,6 +42,9 @@ private:
     QDockWidget *extraLinesDock;
     QPlainTextEdit *extraLinesEdit;
     QLabel *lblNumFrames;
+    QAction *actFollow;
+    QFileSystemWatcher *logWatcher;
+    QTimer *appendTimer;
 };
 
 #endif
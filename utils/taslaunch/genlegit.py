@@ -1,9 +1,17 @@
 #!/usr/bin/env python3
 
+import os
 import sys
 from argparse import ArgumentParser
 from math import copysign
 
+# Hand over to the native converter in utils/legitgen when it has been built.
+# It takes the same arguments and produces the same script, only faster.
+NATIVE = os.path.join(os.path.dirname(os.path.realpath(__file__)), os.pardir,
+                      'legitgen', 'genlegit')
+if os.access(NATIVE, os.X_OK):
+    os.execv(NATIVE, [NATIVE] + sys.argv[1:])
+
 parser = ArgumentParser()
 parser.add_argument('--prepend', metavar='CMDS', help='prepend CMDS to the output')
 parser.add_argument('--append', metavar='CMDS', help='append CMDS to the output')
@@ -11,8 +19,58 @@ parser.add_argument('--hfrval', metavar='FRAMETIME', default='0.0001', help='val
 parser.add_argument('--noendhfr', action='store_true', help='do not print a host_framerate before the final wait')
 parser.add_argument('--save', help='save the game to SAVE at the end of output')
 parser.add_argument('--record', metavar='DEMO', help='record the entire script to DEMO')
+parser.add_argument('--output', metavar='PREFIX', help='write the script to PREFIX.cfg instead of stdout')
+parser.add_argument('--lines', metavar='N', type=int, help='continue in PREFIX1.cfg and so on every N lines')
+parser.add_argument('log', nargs='?', help='log file to read instead of stdin')
 args = parser.parse_args()
 
+if args.lines is not None and args.lines < 1:
+    print('The number of lines must be >= 1.', file=sys.stderr)
+    sys.exit(1)
+
+class SplitOutput:
+    """Write lines to PREFIX.cfg, chaining to the next file every N lines
+    just like splitscript.py."""
+
+    def __init__(self, prefix, nlines):
+        self.prefix = prefix
+        self.nlines = nlines
+        self.filenum = 0
+        self.count = 0
+        self.buf = ''
+        self.outfile = None
+
+    def open_next(self):
+        name = self.prefix + (str(self.filenum) if self.filenum else '') + '.cfg'
+        self.filenum += 1
+        if self.outfile is not None:
+            print('exec "{}"'.format(os.path.basename(name)), file=self.outfile)
+            self.outfile.close()
+        self.outfile = open(name, 'w')
+        self.count = 0
+
+    def write(self, text):
+        self.buf += text
+        while '\n' in self.buf:
+            line, self.buf = self.buf.split('\n', 1)
+            if self.outfile is None:
+                self.open_next()
+            print(line, file=self.outfile)
+            self.count += 1
+            if self.nlines is not None and self.count == self.nlines:
+                self.open_next()
+
+    def flush(self):
+        if self.outfile is not None:
+            self.outfile.flush()
+
+    def close(self):
+        if self.outfile is not None:
+            self.outfile.close()
+            self.outfile = None
+
+log = sys.stdin if args.log is None else open(args.log, newline='\n')
+
 AM_U_2 = 360 / 65536 / 2
 IN_ATTACK = 1 << 0
 IN_JUMP = 1 << 1
@@ -31,13 +89,16 @@ backspd_sign = '-'
 commands = [0] * 10
 pitch = None
 
-for line in sys.stdin:
+for line in log:
     if line.rstrip() == 'CL_SignonReply: 2':
         break
 else:
     print('ERROR: Couldn\'t find "CL_SignonReply: 2"', file=sys.stderr)
     sys.exit(1)
 
+if args.output is not None:
+    sys.stdout = SplitOutput(args.output, args.lines)
+
 if args.prepend is not None:
     print(args.prepend)
 if args.record is not None:
@@ -49,7 +110,7 @@ print('cl_backspeed 10000')
 print('cl_sidespeed 10000')
 print('cl_upspeed 10000')
 
-for line in sys.stdin:
+for line in log:
     if line.startswith('prethink'):
         new_ftime = float(line.rsplit(maxsplit=1)[1])
         if not new_ftime:
@@ -120,3 +181,5 @@ if args.save is not None:
 print('echo TASEND')
 if args.append is not None:
     print(args.append)
+if args.output is not None:
+    sys.stdout.close()
@@ -140,34 +140,24 @@ elif args.action == 'legit':
     if dont_gen_legit is None:
         print('Generating legitimate script...')
         try:
-            with open(sim_log, 'r') as f:
-                genlegit_args = ['genlegit.py', '--hfr', str(host_framerate)]
-                if 'legit_demo' in config_section:
-                    genlegit_args.append('--record')
-                    genlegit_args.append(config_section['legit_demo'])
-                if 'legit_save' in config_section:
-                    genlegit_args.append('--save')
-                    genlegit_args.append(config_section['legit_save'])
-                if 'legit_prepend' in config_section:
-                    genlegit_args.append('--prepend')
-                    genlegit_args.append(config_section['legit_prepend'])
-                if 'legit_append' in config_section:
-                    genlegit_args.append('--append')
-                    genlegit_args.append(config_section['legit_append'])
-
-                genlegit = subprocess.Popen(genlegit_args, stdin=f,
-                                            stdout=subprocess.PIPE)
-                splitscript = subprocess.Popen(
-                    ['splitscript.py', str(lines_per_file), dest_path],
-                    stdin=genlegit.stdout)
-
-                genlegit.wait()
-                if genlegit.returncode:
-                    print_error('genlegit.py returned nonzero')
-
-                splitscript.wait()
-                if splitscript.returncode:
-                    print_error('splitscript.py returned nonzero')
+            genlegit_args = ['genlegit.py', '--hfr', str(host_framerate),
+                             '--output', dest_path,
+                             '--lines', str(lines_per_file), sim_log]
+            if 'legit_demo' in config_section:
+                genlegit_args.append('--record')
+                genlegit_args.append(config_section['legit_demo'])
+            if 'legit_save' in config_section:
+                genlegit_args.append('--save')
+                genlegit_args.append(config_section['legit_save'])
+            if 'legit_prepend' in config_section:
+                genlegit_args.append('--prepend')
+                genlegit_args.append(config_section['legit_prepend'])
+            if 'legit_append' in config_section:
+                genlegit_args.append('--append')
+                genlegit_args.append(config_section['legit_append'])
+
+            if subprocess.call(genlegit_args):
+                print_error('genlegit.py returned nonzero')
         except OSError as e:
             print_error('Failed to generate legitimate script:' + str(e))
 
@@ -0,0 +1,150 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+#include "taslog.hpp"
+#include "taslogcodec.hpp"
+
+static const char USAGE[] =
+    "Usage: taslogdump [-s] [qconsole.taslog]\n"
+    "\n"
+    "Print the records of a binary TAS log written with sv_taslog 2 as the\n"
+    "lines sv_taslog 1 would have printed.  With -s, only count the records\n"
+    "of each type.\n";
+
+static const char *const RECNAMES[] = {"", "prethink", "pmove_pre",
+                                       "pmove_post", "damage", "yawspeed"};
+
+static void print_record(const void *rec)
+{
+    taslog_rechdr_t hdr;
+    std::memcpy(&hdr, rec, sizeof(hdr));
+    switch (hdr.type) {
+    case RecPrethink: {
+        const taslog_prethink_t &r = *(const taslog_prethink_t *)rec;
+        std::printf("prethink %u %.8g\n", r.frameno, r.frametime);
+        std::printf("health %.8g %.8g\n", r.health, r.armor);
+        break;
+    }
+    case RecPmovePre: {
+        const taslog_pmove_pre_t &r = *(const taslog_pmove_pre_t *)rec;
+        std::printf("usercmd %d %u %.8g %.8g\n", (signed char)r.msec,
+                    r.buttons, r.pitch, r.yaw);
+        std::printf("fsu %.8g %.8g %.8g\n", r.fsu[0], r.fsu[1], r.fsu[2]);
+        std::printf("fg %.8g %.8g\n", r.friction, r.gravity);
+        std::printf("pa %.8g %.8g\n", r.punchangle[0], r.punchangle[1]);
+        std::printf("pos 1 %.8g %.8g %.8g\n", r.pos[0], r.pos[1], r.pos[2]);
+        std::printf("pmove 1 %.8g %.8g %.8g %.8g %.8g %.8g %d %u %d %d\n",
+                    r.vel[0], r.vel[1], r.vel[2],
+                    r.basevel[0], r.basevel[1], r.basevel[2],
+                    r.induck, r.flags, r.onground, r.waterlevel);
+        break;
+    }
+    case RecPmovePost: {
+        const taslog_pmove_post_t &r = *(const taslog_pmove_post_t *)rec;
+        std::printf("ntl %d %d\n", r.numtouch, r.ladder);
+        std::printf("pos 2 %.8g %.8g %.8g\n", r.pos[0], r.pos[1], r.pos[2]);
+        std::printf("pmove 2 %.8g %.8g %.8g %.8g %.8g %.8g %d %u %d %d\n",
+                    r.vel[0], r.vel[1], r.vel[2],
+                    r.basevel[0], r.basevel[1], r.basevel[2],
+                    r.induck, r.flags, r.onground, r.waterlevel);
+        break;
+    }
+    case RecDamage: {
+        const taslog_damage_t &r = *(const taslog_damage_t *)rec;
+        std::printf("dmg %.8g %d\n", r.damage, r.bits);
+        break;
+    }
+    case RecYawspeed: {
+        const taslog_yawspeed_t &r = *(const taslog_yawspeed_t *)rec;
+        std::printf("cl_yawspeed %.8g\n", r.yawspeed);
+        break;
+    }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    bool stats = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "sh")) != -1) {
+        switch (opt) {
+        case 's':
+            stats = true;
+            break;
+        default:
+            std::fputs(USAGE, stderr);
+            return opt != 'h';
+        }
+    }
+
+    const char *path = optind < argc ? argv[optind] : "stdin";
+    std::FILE *file = stdin;
+    if (optind < argc) {
+        file = std::fopen(path, "rb");
+        if (!file) {
+            std::fprintf(stderr, "Failed to open %s.\n", path);
+            return 1;
+        }
+    }
+
+    // Decode a buffer at a time, carrying any partial record over to the
+    // next read, so that logs larger than memory can be dumped.
+    std::vector<char> buf(1 << 20);
+    size_t len = 0;
+    size_t offset = 0;
+    bool have_header = false;
+    taslog_reader_t reader;
+    char rec[TASLOG_MAX_RECSIZE];
+    unsigned long counts[RecYawspeed + 1] = {0};
+
+    for (;;) {
+        size_t nread = std::fread(buf.data() + len, 1, buf.size() - len, file);
+        len += nread;
+        const char *p = buf.data();
+        const char *end = p + len;
+
+        ptrdiff_t ret = 1;
+        if (!have_header) {
+            ret = reader.read_header(p, end);
+            if (ret > 0) {
+                have_header = true;
+                p += ret;
+            }
+        }
+        while (have_header && p != end &&
+               (ret = reader.read_record(p, end, rec)) > 0) {
+            taslog_rechdr_t hdr;
+            std::memcpy(&hdr, rec, sizeof(hdr));
+            counts[hdr.type]++;
+            if (!stats)
+                print_record(rec);
+            p += ret;
+        }
+        if (ret < 0) {
+            std::fprintf(stderr, "%s: %s at byte %zu.\n", path,
+                         have_header ? "Corrupt record" : "Not a TAS log",
+                         offset + (p - buf.data()));
+            return 1;
+        }
+
+        offset += p - buf.data();
+        len = end - p;
+        std::memmove(buf.data(), p, len);
+        if (!nread)
+            break;
+    }
+
+    if (!have_header || len) {
+        std::fprintf(stderr, "%s: Truncated at byte %zu.\n", path,
+                     offset + len);
+        return 1;
+    }
+    if (stats) {
+        std::printf("version %u, %zu bytes\n", reader.version(), offset);
+        for (int i = RecPrethink; i <= RecYawspeed; i++)
+            std::printf("%-10s %lu\n", RECNAMES[i], counts[i]);
+    }
+    return 0;
+}
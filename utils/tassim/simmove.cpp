@@ -0,0 +1,561 @@
+#include <cmath>
+#include "simmove.hpp"
+#include "strafemath.hpp"
+
+static const double STEPSIZE = 18;
+static const double STOP_EPSILON = 0.1;
+static const double TIME_TO_DUCK = 0.4;
+static const int MAX_BUMPS = 4;
+static const int MAX_CLIP_PLANES = 5;
+
+struct playerinfo_t
+{
+    double L;
+    double tau;
+    double M;
+    double A;
+    double vel[3];
+    double pos[3];
+    double basevel[3];
+    float viewangles[3];
+    position_t postype;
+    double nofricspd;
+};
+
+// Everything a single frame needs.  The playerinfo_t is our working copy of
+// the player, which is written back to plr once the frame is done.
+struct simctx_t
+{
+    simplayer_t &plr;
+    const simvars_t &vars;
+    const simworld_t &world;
+    playerinfo_t plrinfo;
+};
+
+static inline double dot3(const double a[3], const double b[3])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static pmtrace_t player_trace(const simctx_t &ctx, const double start[3],
+                              const double end[3], int usehull)
+{
+    float fstart[3], fend[3];
+    for (int i = 0; i < 3; i++) {
+        fstart[i] = start[i];
+        fend[i] = end[i];
+    }
+    return ctx.world.trace(ctx.world.ctx, fstart, fend, usehull);
+}
+
+static float get_fric_coef(const simctx_t &ctx)
+{
+    const playerinfo_t &plrinfo = ctx.plrinfo;
+
+    // Return 0 because this is roughly similar to what PM_Friction does.
+    if (std::fabs(plrinfo.vel[0]) < 0.1 && std::fabs(plrinfo.vel[1]) < 0.1)
+        return 0;
+    float k = ctx.vars.friction * ctx.vars.entfriction;
+
+    float speed = std::hypot(plrinfo.vel[0], plrinfo.vel[1]);
+    float start[3], end[3];
+
+    start[0] = end[0] = plrinfo.pos[0] + plrinfo.vel[0] / speed * 16;
+    start[1] = end[1] = plrinfo.pos[1] + plrinfo.vel[1] / speed * 16;
+    start[2] = plrinfo.pos[2] + SIM_PLAYER_MINS[ctx.plr.usehull][2];
+    end[2] = start[2] - 34;
+    pmtrace_t trace = ctx.world.trace(ctx.world.ctx, start, end,
+                                      ctx.plr.usehull);
+    if (trace.fraction == 1)
+        k *= ctx.vars.edgefriction;
+
+    return k;
+}
+
+static void categorize_pos(simctx_t &ctx)
+{
+    playerinfo_t &plrinfo = ctx.plrinfo;
+
+    if (plrinfo.vel[2] > 180) {
+        plrinfo.postype = PositionAir;
+        return;
+    }
+
+    double end[3] = {plrinfo.pos[0], plrinfo.pos[1], plrinfo.pos[2] - 2};
+    pmtrace_t trace = player_trace(ctx, plrinfo.pos, end, ctx.plr.usehull);
+    if (trace.plane.normal[2] < 0.7) {
+        plrinfo.postype = PositionAir;
+        return;
+    }
+
+    plrinfo.postype = PositionGround;
+    if (!trace.startsolid && !trace.allsolid)
+        for (int i = 0; i < 3; i++)
+            plrinfo.pos[i] = trace.endpos[i];
+}
+
+static void load_player_state(simctx_t &ctx)
+{
+    simplayer_t &plr = ctx.plr;
+    playerinfo_t &plrinfo = ctx.plrinfo;
+
+    plrinfo.tau = plr.frametime_acc.next(ctx.vars.frametime) / 1000.0;
+    plrinfo.M = ctx.vars.maxspeed;
+    if (plr.ducking)
+        plrinfo.M *= 0.333;
+
+    for (int i = 0; i < 3; i++) {
+        plrinfo.viewangles[i] = plr.viewangles[i];
+        plrinfo.pos[i] = plr.pos[i];
+        plrinfo.vel[i] = plr.vel[i];
+        plrinfo.basevel[i] = plr.basevel[i];
+    }
+    plrinfo.postype = plr.postype;
+}
+
+static void store_player_state(simctx_t &ctx)
+{
+    simplayer_t &plr = ctx.plr;
+    const playerinfo_t &plrinfo = ctx.plrinfo;
+
+    // The game keeps these in single precision between frames.
+    for (int i = 0; i < 3; i++) {
+        plr.viewangles[i] = plrinfo.viewangles[i];
+        plr.pos[i] = (float)plrinfo.pos[i];
+        plr.vel[i] = (float)plrinfo.vel[i];
+        plr.basevel[i] = (float)plrinfo.basevel[i];
+    }
+    plr.postype = plrinfo.postype;
+}
+
+static void load_player_movevars(simctx_t &ctx)
+{
+    playerinfo_t &plrinfo = ctx.plrinfo;
+
+    // PM_Accelerate and PM_AirAccelerate scale by the friction modifier too.
+    plrinfo.nofricspd = std::hypot(plrinfo.vel[0], plrinfo.vel[1]);
+    if (plrinfo.postype == PositionGround) {
+        double E = ctx.vars.stopspeed;
+        double k = get_fric_coef(ctx);
+        strafe_fric(plrinfo.vel, E, k * plrinfo.tau);
+        plrinfo.L = plrinfo.M;
+        plrinfo.A = ctx.vars.accelerate * ctx.vars.entfriction;
+    } else {
+        plrinfo.L = 30;
+        plrinfo.A = ctx.vars.airaccelerate * ctx.vars.entfriction;
+    }
+}
+
+static void check_velocity(simctx_t &ctx)
+{
+    double maxvel = ctx.vars.maxvelocity;
+    for (int i = 0; i < 3; i++) {
+        if (ctx.plrinfo.vel[i] > maxvel)
+            ctx.plrinfo.vel[i] = maxvel;
+        else if (ctx.plrinfo.vel[i] < -maxvel)
+            ctx.plrinfo.vel[i] = -maxvel;
+    }
+}
+
+static void add_correct_gravity(simctx_t &ctx)
+{
+    playerinfo_t &plrinfo = ctx.plrinfo;
+    float ent_grav = ctx.vars.entgravity;
+    if (!ent_grav)
+        ent_grav = 1;
+    plrinfo.vel[2] -= ent_grav * ctx.vars.gravity * 0.5 * plrinfo.tau;
+    plrinfo.vel[2] += plrinfo.basevel[2] * plrinfo.tau;
+    plrinfo.basevel[2] = 0;
+    check_velocity(ctx);
+}
+
+static void fixup_gravity(simctx_t &ctx)
+{
+    float ent_grav = ctx.vars.entgravity;
+    if (!ent_grav)
+        ent_grav = 1;
+    ctx.plrinfo.vel[2] -= ent_grav * ctx.vars.gravity * 0.5 * ctx.plrinfo.tau;
+    check_velocity(ctx);
+}
+
+static void reduce_timers(simctx_t &ctx)
+{
+    simplayer_t &plr = ctx.plr;
+    if (plr.ducktime > 0) {
+        plr.ducktime -= std::lround(ctx.plrinfo.tau * 1000);
+        if (plr.ducktime < 0)
+            plr.ducktime = 0;
+    }
+}
+
+static void finish_duck(simctx_t &ctx)
+{
+    simplayer_t &plr = ctx.plr;
+    plr.usehull = 1;
+    plr.ducking = true;
+    plr.induck = false;
+
+    // The ducked hull lies entirely within the standing one after the shift,
+    // so PM_FixPlayerCrouchStuck never has anything to do here.
+    if (ctx.plrinfo.postype != PositionAir) {
+        for (int i = 0; i < 3; i++)
+            ctx.plrinfo.pos[i] -= SIM_PLAYER_MINS[1][i] - SIM_PLAYER_MINS[0][i];
+        categorize_pos(ctx);
+    }
+}
+
+static void unduck(simctx_t &ctx)
+{
+    simplayer_t &plr = ctx.plr;
+    playerinfo_t &plrinfo = ctx.plrinfo;
+
+    double neworigin[3] = {plrinfo.pos[0], plrinfo.pos[1], plrinfo.pos[2]};
+    if (plrinfo.postype != PositionAir)
+        for (int i = 0; i < 3; i++)
+            neworigin[i] += SIM_PLAYER_MINS[1][i] - SIM_PLAYER_MINS[0][i];
+
+    pmtrace_t trace = player_trace(ctx, neworigin, neworigin, plr.usehull);
+    if (trace.startsolid)
+        return;
+
+    trace = player_trace(ctx, neworigin, neworigin, 0);
+    if (trace.startsolid) {
+        plr.usehull = 1;
+        return;
+    }
+
+    plr.usehull = 0;
+    plr.ducking = false;
+    plr.induck = false;
+    plr.ducktime = 0;
+    for (int i = 0; i < 3; i++)
+        plrinfo.pos[i] = neworigin[i];
+    categorize_pos(ctx);
+}
+
+static void do_duck(simctx_t &ctx, const siminput_t &in)
+{
+    simplayer_t &plr = ctx.plr;
+    bool pressed = in.duck && !plr.oldduck;
+    plr.oldduck = in.duck;
+
+    if (!in.duck) {
+        if (plr.induck || plr.ducking)
+            unduck(ctx);
+        return;
+    }
+
+    if (pressed && !plr.ducking) {
+        plr.ducktime = 1000;
+        plr.induck = true;
+    }
+
+    if (plr.induck && (plr.ducktime / 1000 <= 1 - TIME_TO_DUCK ||
+                       ctx.plrinfo.postype == PositionAir))
+        finish_duck(ctx);
+}
+
+static void do_jump(simctx_t &ctx)
+{
+    playerinfo_t &plrinfo = ctx.plrinfo;
+
+    // PM_Jump flags the jump even when in the air, so holding jump while
+    // landing does not jump again.
+    if (plrinfo.postype == PositionAir || ctx.plr.oldjump) {
+        ctx.plr.oldjump = true;
+        return;
+    }
+
+    plrinfo.postype = PositionAir;
+    plrinfo.vel[2] = std::sqrt(2 * 800 * 45.0);
+    fixup_gravity(ctx);
+    ctx.plr.oldjump = true;
+}
+
+static void update_line(simctx_t &ctx)
+{
+    simplayer_t &plr = ctx.plr;
+    const playerinfo_t &plrinfo = ctx.plrinfo;
+
+    if (plr.old_moveaction != StrafeLine) {
+        plr.line_origin[0] = plrinfo.pos[0];
+        plr.line_origin[1] = plrinfo.pos[1];
+    }
+
+    double speed = std::hypot(plrinfo.vel[0], plrinfo.vel[1]);
+    if (plr.old_moveaction != StrafeLine && speed <= 0.1) {
+        plr.line_dir[0] = std::cos(plrinfo.viewangles[1] * M_PI / 180);
+        plr.line_dir[1] = std::sin(plrinfo.viewangles[1] * M_PI / 180);
+    } else if (plr.old_moveaction != StrafeLine && speed > 0.1) {
+        plr.line_dir[0] = plrinfo.vel[0] / speed;
+        plr.line_dir[1] = plrinfo.vel[1] / speed;
+    }
+}
+
+static void do_strafe_tas(simctx_t &ctx, const siminput_t &in)
+{
+    playerinfo_t &plrinfo = ctx.plrinfo;
+    double yaw = plrinfo.viewangles[1] * M_PI / 180;
+    double tauMA = plrinfo.tau * plrinfo.M * plrinfo.A;
+    int Sdir = 0, Fdir = 0;
+
+    if (in.action == StrafeLine) {
+        update_line(ctx);
+        strafe_line_opt(yaw, Sdir, Fdir, plrinfo.vel, plrinfo.pos, plrinfo.L,
+                        plrinfo.tau, plrinfo.M * plrinfo.A,
+                        ctx.plr.line_origin, ctx.plr.line_dir);
+    } else if (in.action == StrafeLeft || in.action == StrafeRight) {
+        int dir = in.action == StrafeRight ? 1 : -1;
+        if (in.sideopt)
+            strafe_side_opt(yaw, Sdir, Fdir, plrinfo.vel, plrinfo.L,
+                            tauMA, dir);
+        else
+            strafe_side_const(yaw, Sdir, Fdir, plrinfo.vel, plrinfo.nofricspd,
+                              plrinfo.L, tauMA, dir);
+    } else if (in.action == StrafeBack) {
+        strafe_back(yaw, Sdir, Fdir, plrinfo.vel, tauMA);
+    }
+
+    plrinfo.viewangles[1] = yaw * 180 / M_PI;
+}
+
+static void clip_velocity(const double in[3], const double normal[3],
+                          double out[3], double overbounce)
+{
+    double backoff = dot3(in, normal) * overbounce;
+    for (int i = 0; i < 3; i++) {
+        out[i] = in[i] - normal[i] * backoff;
+        if (out[i] > -STOP_EPSILON && out[i] < STOP_EPSILON)
+            out[i] = 0;
+    }
+}
+
+static void fly_move(simctx_t &ctx)
+{
+    playerinfo_t &plrinfo = ctx.plrinfo;
+    double *vel = plrinfo.vel;
+    double planes[MAX_CLIP_PLANES][3];
+    double original_vel[3], primal_vel[3], new_vel[3];
+    int numplanes = 0;
+    double all_fraction = 0;
+    double time_left = plrinfo.tau;
+
+    for (int i = 0; i < 3; i++)
+        original_vel[i] = primal_vel[i] = new_vel[i] = vel[i];
+
+    for (int bump = 0; bump < MAX_BUMPS; bump++) {
+        if (!vel[0] && !vel[1] && !vel[2])
+            break;
+
+        double end[3];
+        for (int i = 0; i < 3; i++)
+            end[i] = plrinfo.pos[i] + time_left * vel[i];
+        pmtrace_t trace = player_trace(ctx, plrinfo.pos, end, ctx.plr.usehull);
+        all_fraction += trace.fraction;
+        if (trace.allsolid) {
+            vel[0] = vel[1] = vel[2] = 0;
+            return;
+        }
+
+        if (trace.fraction > 0) {
+            for (int i = 0; i < 3; i++) {
+                plrinfo.pos[i] = trace.endpos[i];
+                original_vel[i] = vel[i];
+            }
+            numplanes = 0;
+        }
+        if (trace.fraction == 1)
+            break;
+
+        time_left -= time_left * trace.fraction;
+        if (numplanes >= MAX_CLIP_PLANES) {
+            vel[0] = vel[1] = vel[2] = 0;
+            break;
+        }
+        for (int i = 0; i < 3; i++)
+            planes[numplanes][i] = trace.plane.normal[i];
+        numplanes++;
+
+        if (plrinfo.postype == PositionAir || ctx.vars.entfriction != 1) {
+            double overbounce = 1 + ctx.vars.bounce * (1 - ctx.vars.entfriction);
+            for (int i = 0; i < numplanes; i++) {
+                if (planes[i][2] > 0.7) {
+                    clip_velocity(original_vel, planes[i], new_vel, 1);
+                    for (int j = 0; j < 3; j++)
+                        original_vel[j] = new_vel[j];
+                } else
+                    clip_velocity(original_vel, planes[i], new_vel, overbounce);
+            }
+            for (int i = 0; i < 3; i++)
+                vel[i] = original_vel[i] = new_vel[i];
+            continue;
+        }
+
+        int i, j;
+        for (i = 0; i < numplanes; i++) {
+            clip_velocity(original_vel, planes[i], vel, 1);
+            for (j = 0; j < numplanes; j++)
+                if (j != i && dot3(vel, planes[j]) < 0)
+                    break;
+            if (j == numplanes)
+                break;
+        }
+
+        if (i == numplanes) {
+            // Go along the crease between the two planes.
+            if (numplanes != 2) {
+                vel[0] = vel[1] = vel[2] = 0;
+                break;
+            }
+            double dir[3] = {
+                planes[0][1] * planes[1][2] - planes[0][2] * planes[1][1],
+                planes[0][2] * planes[1][0] - planes[0][0] * planes[1][2],
+                planes[0][0] * planes[1][1] - planes[0][1] * planes[1][0]
+            };
+            double d = dot3(dir, vel);
+            for (int k = 0; k < 3; k++)
+                vel[k] = dir[k] * d;
+        }
+
+        // Stop dead rather than oscillate in corners.
+        if (dot3(vel, primal_vel) <= 0) {
+            vel[0] = vel[1] = vel[2] = 0;
+            break;
+        }
+    }
+
+    if (all_fraction == 0)
+        vel[0] = vel[1] = vel[2] = 0;
+}
+
+static void walk_move(simctx_t &ctx)
+{
+    playerinfo_t &plrinfo = ctx.plrinfo;
+    int usehull = ctx.plr.usehull;
+
+    if (std::sqrt(dot3(plrinfo.vel, plrinfo.vel)) < 1) {
+        plrinfo.vel[0] = plrinfo.vel[1] = plrinfo.vel[2] = 0;
+        return;
+    }
+
+    double dest[3] = {
+        plrinfo.pos[0] + plrinfo.vel[0] * plrinfo.tau,
+        plrinfo.pos[1] + plrinfo.vel[1] * plrinfo.tau,
+        plrinfo.pos[2]
+    };
+    pmtrace_t trace = player_trace(ctx, plrinfo.pos, dest, usehull);
+    if (trace.fraction == 1) {
+        for (int i = 0; i < 3; i++)
+            plrinfo.pos[i] = trace.endpos[i];
+        return;
+    }
+
+    // Try sliding along the ground and stepping up, and keep whichever
+    // went further.
+    double original[3], original_vel[3], down[3], down_vel[3];
+    for (int i = 0; i < 3; i++) {
+        original[i] = plrinfo.pos[i];
+        original_vel[i] = plrinfo.vel[i];
+    }
+
+    fly_move(ctx);
+    for (int i = 0; i < 3; i++) {
+        down[i] = plrinfo.pos[i];
+        down_vel[i] = plrinfo.vel[i];
+        plrinfo.pos[i] = original[i];
+        plrinfo.vel[i] = original_vel[i];
+    }
+
+    for (int i = 0; i < 3; i++)
+        dest[i] = plrinfo.pos[i];
+    dest[2] += STEPSIZE;
+    trace = player_trace(ctx, plrinfo.pos, dest, usehull);
+    if (!trace.startsolid && !trace.allsolid)
+        for (int i = 0; i < 3; i++)
+            plrinfo.pos[i] = trace.endpos[i];
+
+    fly_move(ctx);
+
+    for (int i = 0; i < 3; i++)
+        dest[i] = plrinfo.pos[i];
+    dest[2] -= STEPSIZE;
+    trace = player_trace(ctx, plrinfo.pos, dest, usehull);
+    bool usedown = trace.plane.normal[2] < 0.7;
+    if (!usedown) {
+        if (!trace.startsolid && !trace.allsolid)
+            for (int i = 0; i < 3; i++)
+                plrinfo.pos[i] = trace.endpos[i];
+
+        double downdist = std::pow(down[0] - original[0], 2) +
+            std::pow(down[1] - original[1], 2);
+        double updist = std::pow(plrinfo.pos[0] - original[0], 2) +
+            std::pow(plrinfo.pos[1] - original[1], 2);
+        usedown = downdist > updist;
+    }
+
+    if (usedown) {
+        for (int i = 0; i < 3; i++) {
+            plrinfo.pos[i] = down[i];
+            plrinfo.vel[i] = down_vel[i];
+        }
+    } else
+        plrinfo.vel[2] = down_vel[2];
+}
+
+void sim_init_player(simplayer_t &plr, const double pos[3],
+                     const double vel[3], float yaw)
+{
+    plr = simplayer_t();
+    for (int i = 0; i < 3; i++) {
+        plr.pos[i] = pos[i];
+        plr.vel[i] = vel[i];
+    }
+    plr.viewangles[1] = yaw;
+    plr.postype = PositionAir;
+    plr.old_moveaction = StrafeNone;
+}
+
+void sim_frame(simplayer_t &plr, const siminput_t &in, const simvars_t &vars,
+               const simworld_t &world)
+{
+    simctx_t ctx = {plr, vars, world, playerinfo_t()};
+    playerinfo_t &plrinfo = ctx.plrinfo;
+
+    // The same order as PM_PlayerMove for a walking player out of water.
+    load_player_state(ctx);
+    reduce_timers(ctx);
+    categorize_pos(ctx);
+    do_duck(ctx, in);
+    add_correct_gravity(ctx);
+
+    if (in.jump)
+        do_jump(ctx);
+    else
+        plr.oldjump = false;
+
+    if (plrinfo.postype == PositionGround)
+        plrinfo.vel[2] = 0;
+    load_player_movevars(ctx);
+    check_velocity(ctx);
+
+    if (in.action != StrafeNone)
+        do_strafe_tas(ctx, in);
+
+    for (int i = 0; i < 3; i++)
+        plrinfo.vel[i] += plrinfo.basevel[i];
+    if (plrinfo.postype == PositionGround)
+        walk_move(ctx);
+    else
+        fly_move(ctx);
+
+    categorize_pos(ctx);
+    for (int i = 0; i < 3; i++)
+        plrinfo.vel[i] -= plrinfo.basevel[i];
+    check_velocity(ctx);
+    fixup_gravity(ctx);
+    if (plrinfo.postype == PositionGround)
+        plrinfo.vel[2] = 0;
+
+    plr.old_moveaction = in.action;
+    store_player_state(ctx);
+}
@@ -0,0 +1,121 @@
+#ifndef SIMMOVE_H
+#define SIMMOVE_H
+
+#include "frametime.hpp"
+
+// Offline reimplementation of the player movement that movement.cpp predicts
+// inside the game, so that strafing sequences can be tried without running
+// Half-Life.  The frame follows PM_PlayerMove for a walking player, with the
+// acceleration done by strafemath exactly as do_strafe_tas does it.  Water,
+// ladders and entities other than the world are not simulated.
+
+enum position_t
+{
+    PositionAir,
+    PositionGround,
+    PositionWater,
+};
+
+enum moveaction_t
+{
+    StrafeNone,
+    StrafeLine,
+    StrafeLeft,
+    StrafeRight,
+    StrafeBack,
+};
+
+struct pmplane_t
+{
+    float normal[3];
+    float dist;
+};
+
+struct pmtrace_t
+{
+    int allsolid;
+    int startsolid;
+    int inopen, inwater;
+    float fraction;
+    float endpos[3];
+    pmplane_t plane;
+    int ent;
+    float deltavelocity[3];
+    int hitgroup;
+};
+
+// Player hull mins indexed by usehull: 0 when standing and 1 when ducked.
+const float SIM_PLAYER_MINS[2][3] = {{-16, -16, -36}, {-16, -16, -18}};
+const float SIM_PLAYER_MAXS[2][3] = {{16, 16, 36}, {16, 16, 18}};
+
+// Trace the player hull selected by usehull from start to end.  This stands
+// in for PM_PlayerTrace, so the result must follow its conventions.
+typedef pmtrace_t (*sim_trace_func_t)(void *ctx, const float start[3],
+                                      const float end[3], int usehull);
+
+struct simworld_t
+{
+    sim_trace_func_t trace;
+    void *ctx;
+};
+
+// The movevars and player entvars the movement code reads.
+struct simvars_t
+{
+    float gravity;
+    float stopspeed;
+    float maxspeed;
+    float accelerate;
+    float airaccelerate;
+    float friction;
+    float edgefriction;
+    float bounce;
+    float maxvelocity;
+    float entgravity;
+    float entfriction;
+    double frametime;
+};
+
+// The default Half-Life movevars at 100 fps.
+const simvars_t SIM_DEFAULT_VARS = {
+    800, 100, 320, 10, 10, 4, 2, 1, 2000, 1, 1, 0.01
+};
+
+struct siminput_t
+{
+    moveaction_t action;
+    bool jump;
+    bool duck;
+    // Use strafe_side_opt rather than strafe_side_const, like cl_mtype 1.
+    bool sideopt;
+};
+
+// Everything about the player carried over from one frame to the next.
+struct simplayer_t
+{
+    double pos[3];
+    double vel[3];
+    double basevel[3];
+    float viewangles[3];
+    position_t postype;
+    int usehull;
+    bool induck;
+    bool ducking;
+    float ducktime;
+    bool oldjump;
+    bool oldduck;
+    moveaction_t old_moveaction;
+    double line_origin[2];
+    double line_dir[2];
+    frametime_acc_t frametime_acc;
+};
+
+void sim_init_player(simplayer_t &plr, const double pos[3],
+                     const double vel[3], float yaw);
+
+// Run one player move of vars.frametime seconds, quantized to whole
+// milliseconds as the engine does.
+void sim_frame(simplayer_t &plr, const siminput_t &in, const simvars_t &vars,
+               const simworld_t &world);
+
+#endif
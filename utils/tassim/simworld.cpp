@@ -0,0 +1,275 @@
+#include <cstdio>
+#include <cstring>
+#include "simworld.hpp"
+
+static const float DIST_EPSILON = 0.03125;
+static const int CONTENTS_EMPTY = -1;
+static const int CONTENTS_SOLID = -2;
+
+static const int BSP_VERSION = 30;
+static const int LUMP_PLANES = 1;
+static const int LUMP_CLIPNODES = 9;
+static const int LUMP_MODELS = 14;
+static const int HEADER_LUMPS = 15;
+static const int DMODEL_SIZE = 64;
+static const int DMODEL_HEADNODE_OFS = 36;
+
+// BSP hull used for each player usehull.
+static const int PLAYER_HULLS[2] = {1, 3};
+
+static pmtrace_t empty_trace(const float end[3])
+{
+    pmtrace_t trace;
+    std::memset(&trace, 0, sizeof(trace));
+    trace.fraction = 1;
+    for (int i = 0; i < 3; i++)
+        trace.endpos[i] = end[i];
+    trace.ent = -1;
+    return trace;
+}
+
+// Follow the PM_PlayerTrace conventions for a trace that starts in solid.
+static void finish_trace(pmtrace_t &trace)
+{
+    if (trace.allsolid)
+        trace.startsolid = 1;
+    if (trace.startsolid)
+        trace.fraction = 0;
+    if (trace.fraction < 1 || trace.startsolid)
+        trace.ent = 0;
+}
+
+pmtrace_t flatworld_trace(void *ctx, const float start[3], const float end[3],
+                          int usehull)
+{
+    const flatworld_t *world = (const flatworld_t *)ctx;
+    float floor = world->height - SIM_PLAYER_MINS[usehull][2];
+    float t1 = start[2] - floor;
+    float t2 = end[2] - floor;
+
+    pmtrace_t trace = empty_trace(end);
+    if (t1 < 0 && t2 < 0) {
+        trace.allsolid = 1;
+    } else if (t1 < 0) {
+        trace.startsolid = 1;
+        trace.inopen = 1;
+    } else if (t2 < 0) {
+        float frac = (t1 - DIST_EPSILON) / (t1 - t2);
+        if (frac < 0)
+            frac = 0;
+        trace.inopen = 1;
+        trace.fraction = frac;
+        for (int i = 0; i < 3; i++)
+            trace.endpos[i] = start[i] + frac * (end[i] - start[i]);
+        trace.plane.normal[2] = 1;
+        trace.plane.dist = floor;
+    } else {
+        trace.inopen = 1;
+    }
+
+    finish_trace(trace);
+    return trace;
+}
+
+static int hull_point_contents(const bspworld_t &world, int num,
+                               const float p[3])
+{
+    while (num >= 0) {
+        const dclipnode_t &node = world.clipnodes[num];
+        const dplane_t &plane = world.planes[node.planenum];
+        float d;
+        if (plane.type < 3)
+            d = p[plane.type] - plane.dist;
+        else
+            d = plane.normal[0] * p[0] + plane.normal[1] * p[1] +
+                plane.normal[2] * p[2] - plane.dist;
+        num = node.children[d < 0];
+    }
+    return num;
+}
+
+// The classic recursive hull check.  Returns false once the impact point
+// has been found.
+static bool recursive_hull_check(const bspworld_t &world, int headnode,
+                                 int num, float p1f, float p2f,
+                                 const float p1[3], const float p2[3],
+                                 pmtrace_t &trace)
+{
+    if (num < 0) {
+        if (num != CONTENTS_SOLID) {
+            trace.allsolid = 0;
+            if (num == CONTENTS_EMPTY)
+                trace.inopen = 1;
+            else
+                trace.inwater = 1;
+        } else
+            trace.startsolid = 1;
+        return true;
+    }
+
+    const dclipnode_t &node = world.clipnodes[num];
+    const dplane_t &plane = world.planes[node.planenum];
+    float t1, t2;
+    if (plane.type < 3) {
+        t1 = p1[plane.type] - plane.dist;
+        t2 = p2[plane.type] - plane.dist;
+    } else {
+        t1 = plane.normal[0] * p1[0] + plane.normal[1] * p1[1] +
+            plane.normal[2] * p1[2] - plane.dist;
+        t2 = plane.normal[0] * p2[0] + plane.normal[1] * p2[1] +
+            plane.normal[2] * p2[2] - plane.dist;
+    }
+
+    if (t1 >= 0 && t2 >= 0)
+        return recursive_hull_check(world, headnode, node.children[0],
+                                    p1f, p2f, p1, p2, trace);
+    if (t1 < 0 && t2 < 0)
+        return recursive_hull_check(world, headnode, node.children[1],
+                                    p1f, p2f, p1, p2, trace);
+
+    // Put the crosspoint DIST_EPSILON units on the near side.
+    float frac;
+    if (t1 < 0)
+        frac = (t1 + DIST_EPSILON) / (t1 - t2);
+    else
+        frac = (t1 - DIST_EPSILON) / (t1 - t2);
+    if (frac < 0)
+        frac = 0;
+    else if (frac > 1)
+        frac = 1;
+
+    float midf = p1f + (p2f - p1f) * frac;
+    float mid[3];
+    for (int i = 0; i < 3; i++)
+        mid[i] = p1[i] + frac * (p2[i] - p1[i]);
+
+    int side = t1 < 0;
+    if (!recursive_hull_check(world, headnode, node.children[side],
+                              p1f, midf, p1, mid, trace))
+        return false;
+
+    if (hull_point_contents(world, node.children[side ^ 1], mid) !=
+        CONTENTS_SOLID)
+        return recursive_hull_check(world, headnode, node.children[side ^ 1],
+                                    midf, p2f, mid, p2, trace);
+
+    if (trace.allsolid)
+        return false;
+
+    // The other side of the node is solid, so this is the impact point.
+    if (!side) {
+        for (int i = 0; i < 3; i++)
+            trace.plane.normal[i] = plane.normal[i];
+        trace.plane.dist = plane.dist;
+    } else {
+        for (int i = 0; i < 3; i++)
+            trace.plane.normal[i] = -plane.normal[i];
+        trace.plane.dist = -plane.dist;
+    }
+
+    while (hull_point_contents(world, headnode, mid) == CONTENTS_SOLID) {
+        // Shouldn't really happen, but does occasionally.
+        frac -= 0.1;
+        if (frac < 0) {
+            trace.fraction = midf;
+            for (int i = 0; i < 3; i++)
+                trace.endpos[i] = mid[i];
+            return false;
+        }
+        midf = p1f + (p2f - p1f) * frac;
+        for (int i = 0; i < 3; i++)
+            mid[i] = p1[i] + frac * (p2[i] - p1[i]);
+    }
+
+    trace.fraction = midf;
+    for (int i = 0; i < 3; i++)
+        trace.endpos[i] = mid[i];
+    return false;
+}
+
+pmtrace_t bspworld_trace(void *ctx, const float start[3], const float end[3],
+                         int usehull)
+{
+    const bspworld_t *world = (const bspworld_t *)ctx;
+    int headnode = world->headnode[PLAYER_HULLS[usehull]];
+
+    pmtrace_t trace = empty_trace(end);
+    trace.allsolid = 1;
+    recursive_hull_check(*world, headnode, headnode, 0, 1, start, end, trace);
+    finish_trace(trace);
+    return trace;
+}
+
+static long get_file_size(std::FILE *file)
+{
+    long orig_pos = std::ftell(file);
+    std::fseek(file, 0, SEEK_END);
+    long filesize = std::ftell(file);
+    std::fseek(file, orig_pos, SEEK_SET);
+    return filesize;
+}
+
+template<typename T>
+static bool read_lump(const std::vector<char> &filedat, int lump,
+                      size_t elemsize, std::vector<T> &out)
+{
+    int32_t ofs, len;
+    std::memcpy(&ofs, &filedat[4 + lump * 8], 4);
+    std::memcpy(&len, &filedat[4 + lump * 8 + 4], 4);
+    if (ofs < 0 || len < 0 || (size_t)ofs + len > filedat.size() ||
+        len % elemsize)
+        return false;
+
+    out.resize(len / elemsize);
+    for (size_t i = 0; i < out.size(); i++)
+        std::memcpy(&out[i], &filedat[ofs + i * elemsize], sizeof(T));
+    return true;
+}
+
+bool bspworld_load(bspworld_t &world, const char *path)
+{
+    std::FILE *bspfile = std::fopen(path, "rb");
+    if (!bspfile)
+        return false;
+    long filesize = get_file_size(bspfile);
+    std::vector<char> filedat(filesize > 0 ? filesize : 0);
+    size_t nread = std::fread(filedat.data(), 1, filedat.size(), bspfile);
+    std::fclose(bspfile);
+    if (nread != filedat.size() || filedat.size() < 4 + HEADER_LUMPS * 8)
+        return false;
+
+    int32_t version;
+    std::memcpy(&version, filedat.data(), 4);
+    if (version != BSP_VERSION)
+        return false;
+
+    struct dmodel_raw_t
+    {
+        char data[DMODEL_SIZE];
+    };
+    std::vector<dmodel_raw_t> models;
+    if (!read_lump(filedat, LUMP_PLANES, sizeof(dplane_t), world.planes) ||
+        !read_lump(filedat, LUMP_CLIPNODES, sizeof(dclipnode_t),
+                   world.clipnodes) ||
+        !read_lump(filedat, LUMP_MODELS, DMODEL_SIZE, models) ||
+        models.empty())
+        return false;
+
+    // The world is always the first model.
+    std::memcpy(world.headnode, models[0].data + DMODEL_HEADNODE_OFS,
+                sizeof(world.headnode));
+
+    // Reject anything that would send a trace outside the lumps.
+    int numnodes = world.clipnodes.size();
+    for (int hull : PLAYER_HULLS)
+        if (world.headnode[hull] >= numnodes)
+            return false;
+    for (const dclipnode_t &node : world.clipnodes) {
+        if (node.planenum < 0 || node.planenum >= (int)world.planes.size())
+            return false;
+        for (int i = 0; i < 2; i++)
+            if (node.children[i] >= numnodes)
+                return false;
+    }
+    return true;
+}
@@ -0,0 +1,45 @@
+#ifndef SIMWORLD_H
+#define SIMWORLD_H
+
+#include <cstdint>
+#include <vector>
+#include "simmove.hpp"
+
+// An endless floor at the given height with nothing else in the world.
+struct flatworld_t
+{
+    float height;
+};
+
+pmtrace_t flatworld_trace(void *ctx, const float start[3], const float end[3],
+                          int usehull);
+
+struct dplane_t
+{
+    float normal[3];
+    float dist;
+    int32_t type;
+};
+
+struct dclipnode_t
+{
+    int32_t planenum;
+    int16_t children[2];
+};
+
+// The clipping hulls of the world model from a version 30 BSP file.  Only
+// the player hulls are used, so point traces are not supported.
+struct bspworld_t
+{
+    std::vector<dplane_t> planes;
+    std::vector<dclipnode_t> clipnodes;
+    int headnode[4];
+};
+
+// Returns false if the file cannot be read or is not a valid BSP.
+bool bspworld_load(bspworld_t &world, const char *path);
+
+pmtrace_t bspworld_trace(void *ctx, const float start[3], const float end[3],
+                         int usehull);
+
+#endif
@@ -0,0 +1,306 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include "simmove.hpp"
+#include "simworld.hpp"
+#include "workpool.hpp"
+
+static const char USAGE[] =
+    "Usage: tasopt -x x,y,z [-r radius] [-n frames] [-w width]\n"
+    "              [-b map.bsp | -g height] [-p x,y,z] [-v x,y,z] [-y yaw]\n"
+    "              [-t frametime] [-j threads] [-s]\n"
+    "\n"
+    "Search for the sequence of strafing actions that takes the player to\n"
+    "within radius units of the target in the fewest frames, or failing that\n"
+    "as close as possible after the given number of frames.  The result is\n"
+    "printed as a simulation script, or as a tassim script with -s.\n";
+
+static const moveaction_t ACTIONS[] = {
+    StrafeLine, StrafeLeft, StrafeRight, StrafeBack
+};
+static const int NUM_ACTIONS = sizeof(ACTIONS) / sizeof(ACTIONS[0]);
+static const int NUM_INPUTS = NUM_ACTIONS * 4;
+
+struct candidate_t
+{
+    simplayer_t plr;
+    double dist;
+    int parent;
+    uint8_t input;
+};
+
+struct searchopts_t
+{
+    double target[3];
+    double radius;
+    int maxframes;
+    int width;
+};
+
+static siminput_t get_input(int index)
+{
+    siminput_t in;
+    in.action = ACTIONS[index >> 2];
+    in.jump = index & 1;
+    in.duck = index & 2;
+    in.sideopt = true;
+    return in;
+}
+
+static void score_candidate(candidate_t &cand, const searchopts_t &opts)
+{
+    double sqdist = 0;
+    for (int i = 0; i < 3; i++) {
+        double d = cand.plr.pos[i] - opts.target[i];
+        sqdist += d * d;
+    }
+    cand.dist = std::sqrt(sqdist);
+}
+
+// Two children at the same distance are often the same state reached by
+// inputs that made no difference, and keeping both only narrows the beam.
+static bool same_state(const simplayer_t &a, const simplayer_t &b)
+{
+    return std::memcmp(a.pos, b.pos, sizeof(a.pos)) == 0 &&
+        std::memcmp(a.vel, b.vel, sizeof(a.vel)) == 0 &&
+        a.viewangles[1] == b.viewangles[1] && a.usehull == b.usehull &&
+        a.induck == b.induck && a.ducking == b.ducking &&
+        a.ducktime == b.ducktime && a.oldjump == b.oldjump &&
+        a.oldduck == b.oldduck && a.old_moveaction == b.old_moveaction;
+}
+
+// Beam search over per frame inputs.  Each frame every survivor is expanded
+// by all the inputs across the pool, and the best width distinct children
+// survive.  Returns the inputs of the best candidate found, and its distance
+// to the target in dist.
+static std::vector<uint8_t> search(const simplayer_t &start,
+                                   const searchopts_t &opts,
+                                   const simvars_t &vars,
+                                   const simworld_t &world, workpool_t &pool,
+                                   double &dist)
+{
+    std::vector<candidate_t> beam(1);
+    beam[0].plr = start;
+    beam[0].parent = -1;
+    score_candidate(beam[0], opts);
+
+    std::vector<candidate_t> children;
+    std::vector<int> order;
+    std::vector<std::vector<std::pair<int, uint8_t>>> history;
+    dist = beam[0].dist;
+
+    for (int frame = 0; frame < opts.maxframes && dist > opts.radius;
+         frame++) {
+        children.resize(beam.size() * NUM_INPUTS);
+        pool.run(beam.size(), 16, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                for (int k = 0; k < NUM_INPUTS; k++) {
+                    candidate_t &child = children[i * NUM_INPUTS + k];
+                    child.plr = beam[i].plr;
+                    child.parent = i;
+                    child.input = k;
+                    sim_frame(child.plr, get_input(k), vars, world);
+                    score_candidate(child, opts);
+                }
+            }
+        });
+
+        // Whoever is closest reaches the target first, if anyone does.
+        order.resize(children.size());
+        for (size_t i = 0; i < order.size(); i++)
+            order[i] = i;
+        std::sort(order.begin(), order.end(), [&](int a, int b) {
+            return children[a].dist < children[b].dist;
+        });
+
+        std::vector<candidate_t> survivors;
+        survivors.reserve(opts.width);
+        for (int idx : order) {
+            if ((int)survivors.size() == opts.width)
+                break;
+            const candidate_t &cand = children[idx];
+            if (!survivors.empty() && survivors.back().dist == cand.dist &&
+                same_state(survivors.back().plr, cand.plr))
+                continue;
+            survivors.push_back(cand);
+        }
+
+        history.emplace_back();
+        for (const candidate_t &cand : survivors)
+            history.back().emplace_back(cand.parent, cand.input);
+        beam.swap(survivors);
+        dist = beam[0].dist;
+    }
+
+    std::vector<uint8_t> inputs(history.size());
+    for (int frame = history.size() - 1, idx = 0; frame >= 0; frame--) {
+        inputs[frame] = history[frame][idx].second;
+        idx = history[frame][idx].first;
+    }
+    return inputs;
+}
+
+static void print_sim_script(const std::vector<uint8_t> &inputs)
+{
+    static const char *const action_cmds[] = {
+        nullptr, "linestrafe", "leftstrafe", "rightstrafe", "backpedal"
+    };
+
+    std::printf("cl_mtype 1\n");
+    siminput_t prev = siminput_t();
+    size_t i = 0;
+    while (i < inputs.size()) {
+        siminput_t in = get_input(inputs[i]);
+        size_t count = 1;
+        while (i + count < inputs.size() && inputs[i + count] == inputs[i])
+            count++;
+
+        if (in.action != prev.action) {
+            if (action_cmds[prev.action])
+                std::printf("-%s\n", action_cmds[prev.action]);
+            std::printf("+%s\n", action_cmds[in.action]);
+        }
+        if (in.jump != prev.jump)
+            std::printf("%cjump\n", in.jump ? '+' : '-');
+        if (in.duck != prev.duck)
+            std::printf("%cduck\n", in.duck ? '+' : '-');
+        std::printf("%zu\n", count);
+
+        prev = in;
+        i += count;
+    }
+
+    if (action_cmds[prev.action])
+        std::printf("-%s\n", action_cmds[prev.action]);
+    if (prev.jump)
+        std::printf("-jump\n");
+    if (prev.duck)
+        std::printf("-duck\n");
+}
+
+static void print_tassim_script(const std::vector<uint8_t> &inputs)
+{
+    static const char *const action_names[] = {
+        "none", "line", "left", "right", "back"
+    };
+
+    size_t i = 0;
+    while (i < inputs.size()) {
+        siminput_t in = get_input(inputs[i]);
+        size_t count = 1;
+        while (i + count < inputs.size() && inputs[i + count] == inputs[i])
+            count++;
+        std::printf("%zu %s%s%s opt\n", count, action_names[in.action],
+                    in.jump ? " jump" : "", in.duck ? " duck" : "");
+        i += count;
+    }
+}
+
+static bool parse_vec(const char *str, double vec[3])
+{
+    return std::sscanf(str, "%lf,%lf,%lf", &vec[0], &vec[1], &vec[2]) == 3;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *bsppath = nullptr;
+    flatworld_t flat = {0};
+    double pos[3] = {0, 0, 36};
+    double vel[3] = {0, 0, 0};
+    float yaw = 0;
+    bool tassim_out = false;
+    bool has_target = false;
+    unsigned nthreads = 0;
+    simvars_t vars = SIM_DEFAULT_VARS;
+    searchopts_t opts = {{0, 0, 0}, 16, 1000, 1024};
+
+    int opt;
+    while ((opt = getopt(argc, argv, "x:r:n:w:b:g:p:v:y:t:j:sh")) != -1) {
+        bool ok = true;
+        switch (opt) {
+        case 'x':
+            ok = has_target = parse_vec(optarg, opts.target);
+            break;
+        case 'r':
+            opts.radius = std::atof(optarg);
+            break;
+        case 'n':
+            opts.maxframes = std::atoi(optarg);
+            break;
+        case 'w':
+            opts.width = std::atoi(optarg);
+            ok = opts.width > 0;
+            break;
+        case 'b':
+            bsppath = optarg;
+            break;
+        case 'g':
+            flat.height = std::atof(optarg);
+            break;
+        case 'p':
+            ok = parse_vec(optarg, pos);
+            break;
+        case 'v':
+            ok = parse_vec(optarg, vel);
+            break;
+        case 'y':
+            yaw = std::atof(optarg);
+            break;
+        case 't':
+            vars.frametime = std::atof(optarg);
+            break;
+        case 'j':
+            nthreads = std::atoi(optarg);
+            break;
+        case 's':
+            tassim_out = true;
+            break;
+        default:
+            ok = false;
+            break;
+        }
+        if (!ok) {
+            std::fputs(USAGE, stderr);
+            return opt != 'h';
+        }
+    }
+    if (!has_target) {
+        std::fputs(USAGE, stderr);
+        return 1;
+    }
+
+    bspworld_t bsp;
+    simworld_t world = {flatworld_trace, &flat};
+    if (bsppath) {
+        if (!bspworld_load(bsp, bsppath)) {
+            std::fprintf(stderr, "Failed to load %s.\n", bsppath);
+            return 1;
+        }
+        world.trace = bspworld_trace;
+        world.ctx = &bsp;
+    }
+
+    simplayer_t plr;
+    sim_init_player(plr, pos, vel, yaw);
+
+    workpool_t pool(nthreads);
+    double dist;
+    std::vector<uint8_t> inputs = search(plr, opts, vars, world, pool, dist);
+
+    const char *comment = tassim_out ? "#" : "//";
+    if (dist <= opts.radius)
+        std::printf("%s Reached the target in %zu frames, %.3f units away.\n",
+                    comment, inputs.size(), dist);
+    else
+        std::printf("%s Did not reach the target, %.3f units away after %zu "
+                    "frames.\n", comment, dist, inputs.size());
+    if (tassim_out)
+        print_tassim_script(inputs);
+    else
+        print_sim_script(inputs);
+    return 0;
+}
@@ -0,0 +1,343 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+#include "frametime.hpp"
+#include "strafemath.hpp"
+#include "taslog.hpp"
+#include "taslogcodec.hpp"
+
+static const char USAGE[] =
+    "Usage: taspredict [-t frametime] [-g gravity] [-m maxspeed]\n"
+    "                  [-a airaccelerate] [-e tolerance] log\n"
+    "\n"
+    "Check the frame times movement.cpp predicts with against a TAS log,\n"
+    "written by either sv_taslog 1 or 2.  Each airborne frame without\n"
+    "collisions is moved from pos 1 the way the predictor moves it, once for\n"
+    "each way of getting the frame time, and compared with the logged pos 2.\n"
+    "The frame time is taken from the prethink lines unless -t is given.\n"
+    "Exits with 1 if a frame predicted with the msec from frametime_acc_t\n"
+    "ends up further than the tolerance (0.01 by default) from pos 2.\n";
+
+static const int FL_DUCKING = 1 << 14;
+
+struct options_t
+{
+    double frametime;
+    double gravity;
+    double maxspeed;
+    double airaccel;
+    double tolerance;
+};
+
+struct logframe_t
+{
+    taslog_prethink_t think;
+    taslog_pmove_pre_t pre;
+    taslog_pmove_post_t post;
+    bool have_think;
+    bool have_pre;
+};
+
+struct errstat_t
+{
+    const char *name;
+    unsigned long count;
+    double sum;
+    double max;
+    unsigned int maxframe;
+};
+
+enum taumodel_t
+{
+    TauLogged,
+    TauPredicted,
+    TauFrametime,
+    NUM_TAU_MODELS,
+};
+
+struct checker_t
+{
+    options_t opts;
+    frametime_acc_t acc;
+    unsigned long frames;
+    unsigned long skipped;
+    unsigned long mismatches;
+    errstat_t stats[NUM_TAU_MODELS];
+};
+
+// Move an airborne player by tau seconds like PM_PlayerMove does when
+// PM_FlyMove hits nothing, with the acceleration done by strafemath as in
+// do_strafe_none.
+static void predict_air(const options_t &opts, const taslog_pmove_pre_t &pre,
+                        double tau, double pos[3])
+{
+    double vel[3], basevel[3];
+    for (int i = 0; i < 3; i++) {
+        pos[i] = pre.pos[i];
+        vel[i] = pre.vel[i];
+        basevel[i] = pre.basevel[i];
+    }
+
+    double ent_grav = pre.gravity ? pre.gravity : 1;
+    vel[2] -= ent_grav * opts.gravity * 0.5 * tau;
+    vel[2] += basevel[2] * tau;
+    basevel[2] = 0;
+
+    // PM_CheckParamters, then PM_Duck slowing a ducked player down.
+    double F = pre.fsu[0], S = pre.fsu[1], U = pre.fsu[2];
+    double spd = std::sqrt(F * F + S * S + U * U);
+    if (spd > opts.maxspeed) {
+        F *= opts.maxspeed / spd;
+        S *= opts.maxspeed / spd;
+    }
+    if (pre.flags & FL_DUCKING) {
+        F *= 0.333;
+        S *= 0.333;
+    }
+
+    double ct = std::cos(pre.yaw * M_PI / 180);
+    double st = std::sin(pre.yaw * M_PI / 180);
+    double wishvel[2] = {F * ct + S * st, F * st - S * ct};
+    double wishspeed = std::hypot(wishvel[0], wishvel[1]);
+    if (wishspeed) {
+        double avec[2] = {wishvel[0] / wishspeed, wishvel[1] / wishspeed};
+        if (wishspeed > opts.maxspeed)
+            wishspeed = opts.maxspeed;
+        double L = wishspeed < 30 ? wishspeed : 30;
+        strafe_fme_vec(vel, avec, L,
+                       tau * wishspeed * opts.airaccel * pre.friction);
+    }
+
+    for (int i = 0; i < 3; i++)
+        pos[i] += (vel[i] + basevel[i]) * tau;
+}
+
+static void add_error(errstat_t &stat, const double pos[3],
+                      const taslog_pmove_post_t &post, unsigned int frameno)
+{
+    double err = std::sqrt((pos[0] - post.pos[0]) * (pos[0] - post.pos[0]) +
+                           (pos[1] - post.pos[1]) * (pos[1] - post.pos[1]) +
+                           (pos[2] - post.pos[2]) * (pos[2] - post.pos[2]));
+    stat.count++;
+    stat.sum += err;
+    if (err > stat.max) {
+        stat.max = err;
+        stat.maxframe = frameno;
+    }
+}
+
+static void check_frame(checker_t &chk, const logframe_t &frame)
+{
+    chk.frames++;
+    const taslog_pmove_pre_t &pre = frame.pre;
+    const taslog_pmove_post_t &post = frame.post;
+
+    double frametime = chk.opts.frametime;
+    if (!frametime && frame.have_think)
+        frametime = frame.think.frametime;
+    int msec = chk.acc.next(frametime);
+    if (msec != (int)(unsigned char)pre.msec)
+        chk.mismatches++;
+    chk.acc.sync((unsigned char)pre.msec);
+
+    // Only frames whose outcome does not depend on the map can be predicted
+    // from the log alone.
+    if (pre.onground != -1 || post.onground != -1 || post.numtouch ||
+        post.ladder || pre.waterlevel > 1 || post.waterlevel > 1 ||
+        pre.induck != post.induck ||
+        (pre.flags & FL_DUCKING) != (post.flags & FL_DUCKING)) {
+        chk.skipped++;
+        return;
+    }
+
+    unsigned int frameno = frame.have_think ? frame.think.frameno :
+        (unsigned int)chk.frames;
+    const double taus[NUM_TAU_MODELS] = {(unsigned char)pre.msec / 1000.0,
+                                         msec / 1000.0, frametime};
+    for (int i = 0; i < NUM_TAU_MODELS; i++) {
+        double pos[3];
+        predict_air(chk.opts, pre, taus[i], pos);
+        add_error(chk.stats[i], pos, post, frameno);
+    }
+}
+
+static bool read_binary(checker_t &chk, std::FILE *file, const char *path)
+{
+    std::vector<char> buf(1 << 20);
+    size_t len = 0;
+    bool have_header = false;
+    taslog_reader_t reader;
+    char rec[TASLOG_MAX_RECSIZE];
+    logframe_t frame = logframe_t();
+
+    for (;;) {
+        size_t nread = std::fread(buf.data() + len, 1, buf.size() - len, file);
+        len += nread;
+        const char *p = buf.data();
+        const char *end = p + len;
+
+        ptrdiff_t ret = 1;
+        if (!have_header) {
+            ret = reader.read_header(p, end);
+            if (ret > 0) {
+                have_header = true;
+                p += ret;
+            }
+        }
+        while (have_header && p != end &&
+               (ret = reader.read_record(p, end, rec)) > 0) {
+            taslog_rechdr_t hdr;
+            std::memcpy(&hdr, rec, sizeof(hdr));
+            if (hdr.type == RecPrethink) {
+                std::memcpy(&frame.think, rec, sizeof(frame.think));
+                frame.have_think = true;
+            } else if (hdr.type == RecPmovePre) {
+                std::memcpy(&frame.pre, rec, sizeof(frame.pre));
+                frame.have_pre = true;
+            } else if (hdr.type == RecPmovePost && frame.have_pre) {
+                std::memcpy(&frame.post, rec, sizeof(frame.post));
+                check_frame(chk, frame);
+                frame.have_pre = false;
+            }
+            p += ret;
+        }
+        if (ret < 0) {
+            std::fprintf(stderr, "%s: %s.\n", path,
+                         have_header ? "Corrupt record" : "Not a TAS log");
+            return false;
+        }
+
+        len = end - p;
+        std::memmove(buf.data(), p, len);
+        if (!nread)
+            break;
+    }
+    return true;
+}
+
+static void read_text(checker_t &chk, std::FILE *file)
+{
+    logframe_t frame = logframe_t();
+    taslog_pmove_pre_t &pre = frame.pre;
+    taslog_pmove_post_t &post = frame.post;
+    char line[512];
+    int num;
+
+    while (std::fgets(line, sizeof(line), file)) {
+        if (std::sscanf(line, "prethink %u %f", &frame.think.frameno,
+                        &frame.think.frametime) == 2) {
+            frame.have_think = true;
+        } else if (std::sscanf(line, "usercmd %u %u %f %f", &pre.msec,
+                               &pre.buttons, &pre.pitch, &pre.yaw) == 4) {
+            frame.have_pre = false;
+        } else if (std::sscanf(line, "fsu %f %f %f", &pre.fsu[0], &pre.fsu[1],
+                               &pre.fsu[2]) == 3) {
+        } else if (std::sscanf(line, "fg %f %f", &pre.friction,
+                               &pre.gravity) == 2) {
+        } else if (std::sscanf(line, "ntl %d %d", &post.numtouch,
+                               &post.ladder) == 2) {
+        } else if (std::sscanf(line, "pos %d", &num) == 1) {
+            float *pos = num == 1 ? pre.pos : post.pos;
+            std::sscanf(line, "pos %d %f %f %f", &num, &pos[0], &pos[1],
+                        &pos[2]);
+        } else if (std::sscanf(line, "pmove %d", &num) == 1) {
+            float vel[3], basevel[3];
+            int induck, onground, waterlevel;
+            unsigned int flags;
+            if (std::sscanf(line, "pmove %d %f %f %f %f %f %f %d %u %d %d",
+                            &num, &vel[0], &vel[1], &vel[2], &basevel[0],
+                            &basevel[1], &basevel[2], &induck, &flags,
+                            &onground, &waterlevel) != 11)
+                continue;
+            if (num == 1) {
+                std::memcpy(pre.vel, vel, sizeof(vel));
+                std::memcpy(pre.basevel, basevel, sizeof(basevel));
+                pre.induck = induck;
+                pre.flags = flags;
+                pre.onground = onground;
+                pre.waterlevel = waterlevel;
+                frame.have_pre = true;
+            } else if (frame.have_pre) {
+                std::memcpy(post.vel, vel, sizeof(vel));
+                std::memcpy(post.basevel, basevel, sizeof(basevel));
+                post.induck = induck;
+                post.flags = flags;
+                post.onground = onground;
+                post.waterlevel = waterlevel;
+                check_frame(chk, frame);
+                frame.have_pre = false;
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    checker_t chk = checker_t();
+    chk.opts.gravity = 800;
+    chk.opts.maxspeed = 320;
+    chk.opts.airaccel = 10;
+    chk.opts.tolerance = 0.01;
+    chk.stats[TauLogged].name = "logged msec";
+    chk.stats[TauPredicted].name = "predicted msec";
+    chk.stats[TauFrametime].name = "frametime";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:g:m:a:e:h")) != -1) {
+        switch (opt) {
+        case 't':
+            chk.opts.frametime = std::atof(optarg);
+            break;
+        case 'g':
+            chk.opts.gravity = std::atof(optarg);
+            break;
+        case 'm':
+            chk.opts.maxspeed = std::atof(optarg);
+            break;
+        case 'a':
+            chk.opts.airaccel = std::atof(optarg);
+            break;
+        case 'e':
+            chk.opts.tolerance = std::atof(optarg);
+            break;
+        default:
+            std::fputs(USAGE, stderr);
+            return opt != 'h';
+        }
+    }
+    if (optind != argc - 1) {
+        std::fputs(USAGE, stderr);
+        return 1;
+    }
+
+    const char *path = argv[optind];
+    std::FILE *file = std::fopen(path, "rb");
+    if (!file) {
+        std::fprintf(stderr, "Failed to open %s.\n", path);
+        return 1;
+    }
+    char magic[sizeof(TASLOG_MAGIC)];
+    bool binary = std::fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+        std::memcmp(magic, TASLOG_MAGIC, sizeof(magic)) == 0;
+    std::rewind(file);
+    if (binary) {
+        if (!read_binary(chk, file, path))
+            return 1;
+    } else
+        read_text(chk, file);
+
+    std::printf("%lu frames, %lu compared, %lu msec mismatches\n",
+                chk.frames, chk.frames - chk.skipped, chk.mismatches);
+    std::printf("%-16s %12s %12s %10s\n", "tau from", "mean error",
+                "max error", "at frame");
+    for (int i = 0; i < NUM_TAU_MODELS; i++) {
+        const errstat_t &stat = chk.stats[i];
+        std::printf("%-16s %12.6g %12.6g %10u\n", stat.name,
+                    stat.count ? stat.sum / stat.count : 0, stat.max,
+                    stat.maxframe);
+    }
+    return chk.stats[TauPredicted].max > chk.opts.tolerance;
+}
@@ -0,0 +1,166 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include "simmove.hpp"
+#include "simworld.hpp"
+
+static const char USAGE[] =
+    "Usage: tassim [-b map.bsp | -g height] [-p x,y,z] [-v x,y,z] [-y yaw]\n"
+    "              [-t frametime] [-q] [script]\n"
+    "\n"
+    "Simulate player movement offline.  Each line of the script (or stdin)\n"
+    "reads COUNT ACTION [jump] [duck] [opt], where ACTION is one of none,\n"
+    "line, left, right and back, and runs that many frames.  Lines starting\n"
+    "with # are ignored.\n";
+
+static bool parse_vec(const char *str, double vec[3])
+{
+    return std::sscanf(str, "%lf,%lf,%lf", &vec[0], &vec[1], &vec[2]) == 3;
+}
+
+static bool parse_action(const char *str, moveaction_t &action)
+{
+    static const char *const names[] = {"none", "line", "left", "right",
+                                        "back"};
+    for (int i = 0; i < 5; i++) {
+        if (std::strcmp(str, names[i]) == 0) {
+            action = (moveaction_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_line(char *line, long &count, siminput_t &in)
+{
+    in = siminput_t();
+    char *tok = std::strtok(line, " \t\r\n");
+    if (!tok)
+        return false;
+    count = std::strtol(tok, nullptr, 10);
+    tok = std::strtok(nullptr, " \t\r\n");
+    if (!tok || !parse_action(tok, in.action))
+        return false;
+
+    while ((tok = std::strtok(nullptr, " \t\r\n"))) {
+        if (std::strcmp(tok, "jump") == 0)
+            in.jump = true;
+        else if (std::strcmp(tok, "duck") == 0)
+            in.duck = true;
+        else if (std::strcmp(tok, "opt") == 0)
+            in.sideopt = true;
+        else
+            return false;
+    }
+    return count > 0;
+}
+
+static void print_state(long frame, const simplayer_t &plr)
+{
+    std::printf("%ld %.6f %.6f %.6f %.6f %.6f %.6f %.6f %d %d\n", frame,
+                plr.pos[0], plr.pos[1], plr.pos[2],
+                plr.vel[0], plr.vel[1], plr.vel[2], plr.viewangles[1],
+                plr.postype == PositionGround, plr.usehull);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *bsppath = nullptr;
+    flatworld_t flat = {0};
+    double pos[3] = {0, 0, 36};
+    double vel[3] = {0, 0, 0};
+    float yaw = 0;
+    bool quiet = false;
+    simvars_t vars = SIM_DEFAULT_VARS;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:g:p:v:y:t:qh")) != -1) {
+        switch (opt) {
+        case 'b':
+            bsppath = optarg;
+            break;
+        case 'g':
+            flat.height = std::atof(optarg);
+            break;
+        case 'p':
+            if (!parse_vec(optarg, pos)) {
+                std::fputs(USAGE, stderr);
+                return 1;
+            }
+            break;
+        case 'v':
+            if (!parse_vec(optarg, vel)) {
+                std::fputs(USAGE, stderr);
+                return 1;
+            }
+            break;
+        case 'y':
+            yaw = std::atof(optarg);
+            break;
+        case 't':
+            vars.frametime = std::atof(optarg);
+            break;
+        case 'q':
+            quiet = true;
+            break;
+        default:
+            std::fputs(USAGE, stderr);
+            return opt != 'h';
+        }
+    }
+
+    std::FILE *script = stdin;
+    if (optind < argc) {
+        script = std::fopen(argv[optind], "r");
+        if (!script) {
+            std::fprintf(stderr, "Failed to open %s.\n", argv[optind]);
+            return 1;
+        }
+    }
+
+    bspworld_t bsp;
+    simworld_t world = {flatworld_trace, &flat};
+    if (bsppath) {
+        if (!bspworld_load(bsp, bsppath)) {
+            std::fprintf(stderr, "Failed to load %s.\n", bsppath);
+            return 1;
+        }
+        world.trace = bspworld_trace;
+        world.ctx = &bsp;
+    }
+
+    simplayer_t plr;
+    sim_init_player(plr, pos, vel, yaw);
+
+    long frame = 0;
+    char line[256];
+    auto start = std::chrono::steady_clock::now();
+    for (int lineno = 1; std::fgets(line, sizeof(line), script); lineno++) {
+        if (line[0] == '#' || std::strspn(line, " \t\r\n") == std::strlen(line))
+            continue;
+
+        long count;
+        siminput_t in;
+        if (!parse_line(line, count, in)) {
+            std::fprintf(stderr, "Invalid script line %d.\n", lineno);
+            return 1;
+        }
+        for (long i = 0; i < count; i++) {
+            sim_frame(plr, in, vars, world);
+            if (!quiet)
+                print_state(++frame, plr);
+            else
+                ++frame;
+        }
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    if (quiet)
+        print_state(frame, plr);
+    std::fprintf(stderr, "%ld frames in %.3f s (%.0f frames/s)\n", frame,
+                 elapsed.count(), frame / elapsed.count());
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include <algorithm>
+#include "workpool.hpp"
+
+workpool_t::workpool_t(unsigned nthreads)
+    : cur_func(nullptr), pending(0), generation(0), quit(false)
+{
+    if (!nthreads)
+        nthreads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < nthreads; i++)
+        workers.emplace_back(new worker_t);
+
+    // Worker 0 is whoever calls run.
+    for (unsigned i = 1; i < nthreads; i++)
+        threads.emplace_back(&workpool_t::worker_main, this, i);
+}
+
+workpool_t::~workpool_t()
+{
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        quit = true;
+    }
+    start_cv.notify_all();
+    for (std::thread &thread : threads)
+        thread.join();
+}
+
+bool workpool_t::pop_range(unsigned id, range_t &range)
+{
+    {
+        worker_t &own = *workers[id];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.ranges.empty()) {
+            range = own.ranges.back();
+            own.ranges.pop_back();
+            return true;
+        }
+    }
+
+    for (unsigned i = 1; i < workers.size(); i++) {
+        worker_t &victim = *workers[(id + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.ranges.empty()) {
+            range = victim.ranges.front();
+            victim.ranges.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void workpool_t::do_ranges(unsigned id)
+{
+    range_t range;
+    while (pop_range(id, range)) {
+        (*cur_func)(range.first, range.second);
+        if (--pending == 0) {
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            done_cv.notify_all();
+        }
+    }
+}
+
+void workpool_t::worker_main(unsigned id)
+{
+    unsigned seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(pool_mutex);
+            start_cv.wait(lock, [&] { return generation != seen || quit; });
+            if (quit)
+                return;
+            seen = generation;
+        }
+        do_ranges(id);
+    }
+}
+
+void workpool_t::run(size_t count, size_t grain, const task_func_t &func)
+{
+    if (!count)
+        return;
+    grain = std::max<size_t>(grain, 1);
+
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        cur_func = &func;
+        // A worker still stealing from the last batch may pick up a range as
+        // soon as it is pushed, so the count has to be in place first.
+        pending = (count + grain - 1) / grain;
+        size_t n = 0;
+        for (size_t begin = 0; begin < count; begin += grain, n++) {
+            worker_t &worker = *workers[n % workers.size()];
+            std::lock_guard<std::mutex> wlock(worker.mutex);
+            worker.ranges.emplace_back(begin, std::min(begin + grain, count));
+        }
+        generation++;
+    }
+    start_cv.notify_all();
+
+    do_ranges(0);
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    done_cv.wait(lock, [this] { return pending == 0; });
+}
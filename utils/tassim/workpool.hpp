@@ -0,0 +1,58 @@
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+typedef std::function<void(size_t, size_t)> task_func_t;
+
+// A fixed set of threads for running batches of index ranges.  Every thread
+// owns a deque of ranges which it works through from the back, and once that
+// runs dry it steals from the front of the others, so uneven ranges still
+// keep every core busy.
+class workpool_t
+{
+public:
+    // Zero means one thread per core.  The calling thread counts as one.
+    explicit workpool_t(unsigned nthreads = 0);
+    ~workpool_t();
+
+    unsigned size() const { return workers.size(); }
+
+    // Call func(begin, end) over [0, count) split into ranges of at most
+    // grain indices, and return once all of them are done.
+    void run(size_t count, size_t grain, const task_func_t &func);
+
+private:
+    typedef std::pair<size_t, size_t> range_t;
+
+    struct worker_t
+    {
+        std::mutex mutex;
+        std::deque<range_t> ranges;
+    };
+
+    bool pop_range(unsigned id, range_t &range);
+    void do_ranges(unsigned id);
+    void worker_main(unsigned id);
+
+    std::vector<std::unique_ptr<worker_t>> workers;
+    std::vector<std::thread> threads;
+    std::mutex pool_mutex;
+    std::condition_variable start_cv;
+    std::condition_variable done_cv;
+    const task_func_t *cur_func;
+    std::atomic<size_t> pending;
+    unsigned generation;
+    bool quit;
+};
+
+#endif